@@ -12,6 +12,7 @@ source $EMSDK/emsdk_env.sh
 
 cd $OPENCV_SDK
 python ./platforms/js/build_js.py build_wasm --build_wasm
+python ./platforms/js/build_js.py build_wasm_mt --build_wasm --threads --simd
 
 cd .. && cd ..
 cmake -DCMAKE_TOOLCHAIN_FILE=${EMSDK}/upstream/emscripten/cmake/Modules/Platform/Emscripten.cmake
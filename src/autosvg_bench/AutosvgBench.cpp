@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <core/AutosvgConverter.hpp>
+#include <core/BoundaryTracer.hpp>
+#include <core/ColorQuantizer.hpp>
+#include <core/Operations.hpp>
+#include <core/PaletteMapper.hpp>
+#include <core/TiledConversion.hpp>
+#include <utils/BezierFitting.hpp>
+#include <utils/CurveUtils.hpp>
+#include "Benchmark.hpp"
+
+#ifndef AUTOSVG_TEST_IMAGES
+#define AUTOSVG_TEST_IMAGES "../../assets/test_images"
+#endif
+
+#define BENCH_IMAGE_WIDTH 600
+
+using namespace std;
+
+struct SegmentRange {
+    size_t begin;
+    size_t count;
+};
+
+struct BenchImage {
+    string name;
+    cv::Mat image;
+};
+
+/**
+ * Samples random cubics into one contour, rounded to the pixel grid like
+ * traced boundaries are.
+ */
+static Contour sampleSegments(size_t segments, int minPoints, int maxPoints, vector<SegmentRange> &ranges) {
+    cv::RNG rng(0x5eed);
+    Contour contour;
+    cv::Point2f start(0, 0);
+    for (size_t s = 0; s < segments; s++) {
+        cv::Point2f control[4] = {start};
+        for (int i = 1; i < 4; i++) {
+            control[i] = control[i - 1] + cv::Point2f(rng.uniform(-40.f, 40.f), rng.uniform(-40.f, 40.f));
+        }
+        const int points = rng.uniform(minPoints, maxPoints + 1);
+        ranges.push_back({contour.size(), (size_t) points});
+        for (int i = 0; i < points; i++) {
+            const float t = i / float(points - 1), u = 1 - t;
+            const cv::Point2f p = u * u * u * control[0] + 3 * t * u * u * control[1] +
+                                  3 * t * t * u * control[2] + t * t * t * control[3];
+            contour.push_back(cv::Point(cvRound(p.x), cvRound(p.y)));
+        }
+        start = control[3];
+    }
+    return contour;
+}
+
+/**
+ * Overlapping discs in a few flat colours, `blobs` controls how many
+ * contours the tracer finds.
+ */
+static BenchImage syntheticImage(int size, int blobs) {
+    cv::RNG rng(0x5eed + size + blobs);
+    cv::Mat image(size, size, CV_8UC3, cv::Scalar(240, 240, 240));
+    for (int i = 0; i < blobs; i++) {
+        const cv::Scalar color(rng.uniform(0, 4) * 80, rng.uniform(0, 4) * 80, rng.uniform(0, 4) * 80);
+        const cv::Point center(rng.uniform(0, size), rng.uniform(0, size));
+        const int radius = rng.uniform(size / 64 + 4, size / 6 + 8);
+        cv::circle(image, center, radius, color, cv::FILLED);
+    }
+    return {"synthetic" + to_string(size) + "x" + to_string(blobs), image};
+}
+
+static vector<BenchImage> benchImages() {
+    vector<BenchImage> images;
+    vector<string> files;
+    cv::glob(string(AUTOSVG_TEST_IMAGES) + "/*", files);
+    for (const auto &file : files) {
+        cv::Mat image = cv::imread(file, cv::IMREAD_COLOR);
+        if (image.empty()) {
+            continue;
+        }
+        // Same working size as the cli pipeline.
+        const double ratio = image.rows / (image.cols * 1.0);
+        cv::resize(image, image, cv::Size(BENCH_IMAGE_WIDTH, int(BENCH_IMAGE_WIDTH * ratio)), 0, 0);
+        images.push_back({file.substr(file.find_last_of("/\\") + 1), image});
+    }
+    images.push_back(syntheticImage(256, 16));
+    images.push_back(syntheticImage(256, 128));
+    images.push_back(syntheticImage(1024, 64));
+    images.push_back(syntheticImage(1024, 512));
+    return images;
+}
+
+static void benchmarkBezierFitting(int minPoints, int maxPoints) {
+    vector<SegmentRange> ranges;
+    const Contour contour = sampleSegments(4096, minPoints, maxPoints, ranges);
+    CurveSegment segment;
+    pi::runBenchmark("fit/BezierFitting/" + to_string(minPoints) + "-" + to_string(maxPoints) + " points",
+                     ranges.size(), [&]() {
+                for (const auto &range : ranges) {
+                    pi::BezierFitting::fit(contour, range.begin, range.count, segment);
+                }
+            });
+}
+
+static void benchmarkStages(const BenchImage &input, unsigned int k) {
+    cv::Mat image = input.image;
+    const double pixels = image.total();
+    const string suffix = "/" + input.name + "/k=" + to_string(k);
+
+    cv::Mat quantized, labels;
+    pi::runBenchmark("quantize/histogram" + suffix, pixels, [&]() {
+        pi::Operations::colorSegmentation(&image, &quantized, k, HISTOGRAM_QUANTIZATION, &labels);
+    });
+    pi::runBenchmark("quantize/kmeans" + suffix, pixels, [&]() {
+        pi::Operations::colorSegmentation(&image, &quantized, k, KMEANS_QUANTIZATION, &labels);
+    });
+
+    pi::Operations::colorSegmentation(&image, &quantized, k, HISTOGRAM_QUANTIZATION, &labels);
+    pi::runBenchmark("trace/boundaries" + suffix, pixels, [&]() {
+        pi::Operations::traceLabelBoundaries(labels);
+    });
+    pi::runBenchmark("trace/contours" + suffix, pixels, [&]() {
+        pi::Operations::findLabelContours(labels, k);
+    });
+
+    cv::Mat edgeImage;
+    pi::runBenchmark("edges/findColorSegmentedEdge" + suffix, pixels, [&]() {
+        pi::Operations::findColorSegmentedEdge(&image, &edgeImage, k);
+    });
+
+    const vector<Contour> edges = pi::Operations::findColorSegmentedEdge(&image, &edgeImage, k).edges;
+    pi::runBenchmark("color/findContoursAvgColor" + suffix, edges.size(), [&]() {
+        pi::Operations::findContoursAvgColor(image, edges);
+    });
+
+    const vector<Pixel> colors = pi::Operations::findContoursAvgColor(image, edges);
+    pi::runBenchmark("fit/simplified" + suffix, edges.size(), [&]() {
+        pi::CurveUtils::convertContoursToBezierCurves(edges, SHARPNESS, colors, SIMPLIFIED_FITTING);
+    });
+    pi::runBenchmark("fit/adaptive" + suffix, edges.size(), [&]() {
+        pi::CurveUtils::convertContoursToBezierCurves(edges, SHARPNESS, colors, ADAPTIVE_FITTING);
+    });
+
+    const vector<Curve> curves = pi::CurveUtils::convertContoursToBezierCurves(edges, SHARPNESS, colors);
+    const vector<SVGParam> params = {
+            {"width",  to_string(image.cols)},
+            {"height", to_string(image.rows)},
+            {"xmlns",  "http://www.w3.org/2000/svg"}
+    };
+    pi::runBenchmark("serialize/createSvgFromBezierCurves" + suffix, curves.size(), [&]() {
+        pi::CurveUtils::createSvgFromBezierCurves(curves, params);
+    });
+
+    // Whole conversions, with a fresh context per image and with the pooled
+    // one a long running converter keeps.
+    pi::ConversionOptions options;
+    options.colors = k;
+    options.width = 0;
+    const pi::AutosvgConverter converter(options);
+    pi::BufferSink sink;
+    pi::runBenchmark("convert/fresh" + suffix, pixels, [&]() {
+        pi::ConversionContext context;
+        sink.buffer.clear();
+        converter.convert(image, pi::RGB_FORMAT, sink, nullptr, &context);
+    });
+    pi::runBenchmark("convert/pooled" + suffix, pixels, [&]() {
+        sink.buffer.clear();
+        converter.convert(image, pi::RGB_FORMAT, sink);
+    });
+}
+
+/**
+ * Every directed boundary edge and the signed area of every label's
+ * boundaries, keyed by the label they are painted with. Both are the same
+ * however boundaries meeting in a corner are split into loops.
+ */
+struct TracedBoundaries {
+    vector<tuple<int, int, int, int, int>> edges;
+    map<int, double> areas;
+
+    void add(const Contour &contour, int painted) {
+        for (size_t i = 0; i < contour.size(); i++) {
+            const cv::Point &from = contour[i], &to = contour[(i + 1) % contour.size()];
+            edges.emplace_back(painted, from.x, from.y, to.x, to.y);
+        }
+        areas[painted] += pi::BoundaryTracer::signedArea(contour);
+    }
+
+    bool matches(TracedBoundaries &other) {
+        sort(edges.begin(), edges.end());
+        sort(other.edges.begin(), other.edges.end());
+        return edges == other.edges && areas == other.areas;
+    }
+};
+
+/**
+ * Traces `input` whole and in tiles of `tileSize` and checks that the seams
+ * were stitched into the same boundaries. Prints the result and returns
+ * whether they match.
+ */
+static bool checkTiledTracing(const BenchImage &input, unsigned int k, int tileSize) {
+    const string name = "check/tiled/" + input.name + "/k=" + to_string(k) + "/tile=" + to_string(tileSize);
+    if (name.find(pi::benchmarkFilter()) == string::npos) {
+        return true;
+    }
+    const cv::Mat &image = input.image;
+    pi::ConversionContext context;
+    pi::ColorQuantizer::buildHistogram(image, context.histogram);
+    const vector<cv::Vec3b> palette = pi::ColorQuantizer::histogramPalette(context.histogram.histogram, k);
+
+    TracedBoundaries whole;
+    cv::Mat labels;
+    vector<Contour> contours;
+    vector<int> contourLabels;
+    pi::PaletteMapper::assignLabels(image, palette, &labels);
+    pi::BoundaryTracer::trace(labels, -1, numeric_limits<double>::max(), &contours, &contourLabels);
+    for (size_t i = 0; i < contours.size(); i++) {
+        whole.add(contours[i], pi::BoundaryTracer::insideLabel(labels, contours[i], contourLabels[i]));
+    }
+
+    TracedBoundaries tiled;
+    pi::SeamStitcher stitcher;
+    vector<Contour> closed;
+    vector<int> closedLabels;
+    const cv::Rect bounds(0, 0, image.cols, image.rows);
+    for (int y = 0; y < image.rows; y += tileSize) {
+        for (int x = 0; x < image.cols; x += tileSize) {
+            const cv::Rect tile = cv::Rect(x, y, tileSize, tileSize) & bounds;
+            pi::TiledConversion::traceTile(image, pi::RGB_FORMAT, palette, tile, context, stitcher, closed,
+                                           closedLabels);
+            for (size_t i = 0; i < closed.size(); i++) {
+                tiled.add(closed[i], closedLabels[i]);
+            }
+        }
+    }
+
+    const bool matches = stitcher.openChains() == 0 && whole.matches(tiled);
+    cout << left << setw(48) << name << (matches ? "ok" : "MISMATCH") << endl;
+    return matches;
+}
+
+/**
+ * Usage: autosvg-bench [filter], runs every check and benchmark whose name
+ * contains `filter`, e.g. "trace/", "check/" or "synthetic1024". Exits with 1
+ * when a check fails.
+ */
+int main(int argc, char **argv) {
+    pi::enableAllocationCounting();
+    if (argc > 1) {
+        pi::benchmarkFilter() = argv[1];
+    }
+
+    // A mismatch fails the run before anything is timed.
+    const vector<BenchImage> images = benchImages();
+    bool stitched = true;
+    for (const auto &input : images) {
+        for (int tileSize : {37, 64}) {
+            stitched = checkTiledTracing(input, 8, tileSize) && stitched;
+        }
+    }
+    if (!stitched) {
+        return 1;
+    }
+
+    benchmarkBezierFitting(4, 8);
+    benchmarkBezierFitting(8, 32);
+    benchmarkBezierFitting(32, 128);
+
+    for (const auto &input : images) {
+        for (unsigned int k : {3u, 8u, 16u}) {
+            benchmarkStages(input, k);
+        }
+    }
+    return 0;
+}
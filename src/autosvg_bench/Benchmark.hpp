@@ -0,0 +1,59 @@
+#ifndef AUTOSVG_BENCH_BENCHMARK_HPP
+#define AUTOSVG_BENCH_BENCHMARK_HPP
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include <cli/AllocationHooks.hpp>
+
+#define BENCHMARK_MIN_SECONDS 0.5
+
+namespace pi {
+
+    /**
+     * Only benchmarks whose name contains this string are run.
+     */
+    inline std::string &benchmarkFilter() {
+        static std::string filter;
+        return filter;
+    }
+
+    /**
+     * Runs `operation` until at least BENCHMARK_MIN_SECONDS have passed and
+     * prints the time per call, the throughput of `itemsPerOperation` and the
+     * heap traffic per call.
+     */
+    inline void runBenchmark(const std::string &name, double itemsPerOperation,
+                             const std::function<void()> &operation) {
+        if (name.find(benchmarkFilter()) == std::string::npos) {
+            return;
+        }
+        typedef std::chrono::steady_clock Clock;
+        operation();
+
+        size_t iterations = 0;
+        double seconds = 0;
+        const AllocationStats before = allocationStats();
+        auto start = Clock::now();
+        for (size_t batch = 1; seconds < BENCHMARK_MIN_SECONDS; batch *= 2) {
+            for (size_t i = 0; i < batch; i++) {
+                operation();
+            }
+            iterations += batch;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        const AllocationStats after = allocationStats();
+
+        std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << seconds * 1e9 / iterations << " ns/op"
+                  << std::setw(14) << itemsPerOperation * iterations / seconds << " items/sec"
+                  << std::setw(12) << double(after.bytes - before.bytes) / iterations << " B/op"
+                  << std::setw(10) << double(after.count - before.count) / iterations << " allocs/op"
+                  << std::endl;
+    }
+}
+
+#endif //AUTOSVG_BENCH_BENCHMARK_HPP
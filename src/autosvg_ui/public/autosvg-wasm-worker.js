@@ -1,33 +1,180 @@
-self.importScripts('./autosvg-wasm.js');
+// Smallest module using a v128 instruction, valid only where wasm simd is supported.
+const SIMD_PROBE = new Uint8Array([0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11]);
+
+// The threaded build needs SharedArrayBuffer, which browsers only expose to
+// cross-origin isolated pages.
+function supportsThreadedBuild() {
+    return self.crossOriginIsolated === true &&
+        typeof SharedArrayBuffer !== 'undefined' &&
+        WebAssembly.validate(SIMD_PROBE);
+}
+
+// Loads a build into a fresh Module and resolves once its runtime is up.
+// Failures while fetching or instantiating the wasm are asynchronous, so
+// they reject through onAbort rather than throw from importScripts.
+function loadBuild(script, options) {
+    return new Promise(function(resolve, reject) {
+        self.Module = Object.assign({
+            onRuntimeInitialized: function() {
+                resolve();
+            },
+            onAbort: function(reason) {
+                reject(reason);
+            },
+        }, options);
+        try {
+            self.importScripts(script);
+        } catch (error) {
+            reject(error);
+        }
+    });
+}
+
+function loadConverter() {
+    if (supportsThreadedBuild()) {
+        // Pthread workers are started from this url, not the worker's own.
+        return loadBuild('./autosvg-wasm-mt.js', { mainScriptUrlOrBlob: './autosvg-wasm-mt.js' })
+            .catch(function(error) {
+                console.warn('Falling back to the single threaded converter', error);
+                return loadBuild('./autosvg-wasm.js', {});
+            });
+    }
+    return loadBuild('./autosvg-wasm.js', {});
+}
+
+const converterLoaded = loadConverter();
+
+// With threads the heap may grow on any thread and Module.HEAPU8 is only
+// refreshed by the runtime's own accesses, so every view is taken anew
+// from the memory after a call that can allocate.
+function heapU8() {
+    const memory = Module.wasmMemory;
+    if (memory && Module.HEAPU8.buffer !== memory.buffer) {
+        return new Uint8Array(memory.buffer);
+    }
+    return Module.HEAPU8;
+}
+
+// Scratch memory is released once no job arrived for this long.
+const RELEASE_SCRATCH_AFTER_MS = 30000;
+
+let inst = null;
+let releaseTimer = null;
+// Size of the image the converter holds, images are traced at their size.
+let rows = 0;
+let cols = 0;
+
+function converter() {
+    if (inst === null) {
+        inst = new Module.AutosvgWASM();
+    }
+    return inst;
+}
+
+// Builds published before the scratch buffer api only expose loadImage and
+// convertToSvg, which trace a caller owned copy of the pixels and draw the
+// edges back into it.
+function supportsScratchBuffers(converterInst) {
+    return typeof converterInst.imageBuffer === 'function' &&
+        typeof converterInst.convert === 'function';
+}
+
+let lastImage = null;
+
+function convertWithLegacyApi(converterInst, imageData, kColors, sharpness, withEdges) {
+    if (imageData) {
+        lastImage = imageData;
+    } else if (lastImage === null) {
+        return null;
+    }
+    rows = lastImage.height;
+    cols = lastImage.width;
+    const byteCount = rows * cols * 4;
+    const dataPtr = Module._malloc(byteCount);
+    heapU8().set(lastImage.data, dataPtr);
+    converterInst.loadImage(dataPtr, rows, cols);
+    const svg = converterInst.convertToSvg(kColors, sharpness);
+    let edges = null;
+    if (withEdges) {
+        edges = new ImageData(new Uint8ClampedArray(heapU8().slice(dataPtr, dataPtr + byteCount).buffer), cols, rows);
+    }
+    Module._free(dataPtr);
+    return { svg, edges };
+}
+
+// A null image converts the last one again, e.g. when only a slider moved,
+// which reuses every stage the changed parameter does not affect.
+// With `progressive` the svg is posted as `{ partial: true, blobUrl }` while
+// it is fitted, largest shapes first, before the final message. The legacy
+// api only posts the final message.
 onmessage = function(e) {
-    console.log('Message received from main script');
+    // Jobs sent while the runtime loads wait for it, in order.
+    converterLoaded.then(function() {
+        convertMessage(e);
+    }, function(error) {
+        console.error('Unable to load the converter', error);
+        postMessage(null);
+    });
+}
 
-    const _Module = Module;
-    const AutosvgWASM = _Module.AutosvgWASM;
+function convertMessage(e) {
+    const [imageData, kColors, sharpness, withEdges, progressive] = e.data;
+    const converterInst = converter();
+    clearTimeout(releaseTimer);
 
-    const inst = new AutosvgWASM();
+    let svg;
+    let edges = null;
+    if (!supportsScratchBuffers(converterInst)) {
+        const result = convertWithLegacyApi(converterInst, imageData, kColors, sharpness, withEdges);
+        if (result === null) {
+            postMessage(null);
+            return;
+        }
+        svg = result.svg;
+        edges = result.edges;
+    } else {
+        if (imageData) {
+            // The heap may grow while the buffer is allocated, so the view is taken afterwards.
+            rows = imageData.height;
+            cols = imageData.width;
+            const dataPtr = converterInst.imageBuffer(rows, cols);
+            heapU8().set(imageData.data, dataPtr);
+        } else if (!converterInst.hasImage()) {
+            postMessage(null);
+            return;
+        }
 
-    const [imageData, kColors, sharpness] = e.data;
-    const imageDataBuffer = imageData.data.buffer;
-    const rows = imageData.height;
-    const cols = imageData.width;
-    const byteCounts = imageDataBuffer.byteLength;
-    const dataPtr = _Module._malloc(byteCounts);
-    const dataOnHeap = new Uint8ClampedArray(
-    _Module.HEAPU8.buffer,
-    dataPtr,
-    byteCounts
-    );
-    dataOnHeap.set(imageData.data);
+        if (progressive) {
+            let written = '';
+            svg = converterInst.convertProgressively(kColors, sharpness, !!withEdges, function(chunk) {
+                written += chunk;
+                // The last chunk closes the document, which the final message carries.
+                if (!written.endsWith('</svg>')) {
+                    const preview = new Blob([written + '</svg>'], { type: "image/svg+xml" });
+                    postMessage({ partial: true, blobUrl: URL.createObjectURL(preview) });
+                }
+            });
+        } else {
+            svg = converterInst.convert(kColors, sharpness, !!withEdges);
+        }
+        if (withEdges) {
+            const dataPtr = converterInst.pixelBuffer();
+            edges = new ImageData(new Uint8ClampedArray(heapU8().slice(dataPtr, dataPtr + rows * cols * 4).buffer), cols, rows);
+        }
 
-    inst.loadImage(dataOnHeap.byteOffset, rows, cols);
+        releaseTimer = setTimeout(function() {
+            converterInst.releaseScratch();
+        }, RELEASE_SCRATCH_AFTER_MS);
+    }
 
-    const svg = inst.convertToSvg(kColors, sharpness);
     const blob = new Blob([svg], {
         type: "image/svg+xml",
     });
-
     const blobUrl = URL.createObjectURL(blob);
-    _Module._free(dataPtr);
-    postMessage({ blobUrl, svg });
-}
\ No newline at end of file
+
+    if (edges) {
+        postMessage({ blobUrl, svg, edges }, [edges.data.buffer]);
+    } else {
+        postMessage({ blobUrl, svg });
+    }
+}
@@ -101,24 +101,50 @@ function convertToJSON(svgContent: string) {
   };
 }
 
+// The worker keeps the last image, it is only sent again after it changed.
+let imageVersion = 0;
+let sentImageVersion = -1;
+
 function convertImageToSvg(
   canvas: HTMLCanvasElement,
   kColors: number,
-  sharpness: number
+  sharpness: number,
+  onPartial?: (blobUrl: string) => void
 ) {
+    const progressive = !!onPartial;
     return new Promise<any>((resolve, reject) => {
-        
-        const ctx = canvas.getContext("2d");
-        if (ctx == null) {
-            reject('Error loading canvas');
-            return;
-        }
-        const imageData = ctx.getImageData(0, 0, canvas.width, canvas.height);
+        if (sentImageVersion === imageVersion) {
+            autosvgWasmWorker.postMessage([null, kColors, sharpness, false, progressive]);
+        } else {
+            const ctx = canvas.getContext("2d");
+            if (ctx == null) {
+                reject('Error loading canvas');
+                return;
+            }
+            const imageData = ctx.getImageData(0, 0, canvas.width, canvas.height);
 
-        autosvgWasmWorker.postMessage([imageData, kColors, sharpness]);
+            // The pixels are transferred, not copied, since the canvas keeps its own.
+            autosvgWasmWorker.postMessage([imageData, kColors, sharpness, false, progressive],
+                [imageData.data.buffer]);
+            sentImageVersion = imageVersion;
+        }
 
+        // Each preview replaces the last one, which is released right away.
+        let partialUrl: string | null = null;
         // @ts-ignore
-        autosvgWasmWorker.addEventListener('message', function(e) {
+        autosvgWasmWorker.addEventListener('message', function onMessage(e) {
+            if (partialUrl !== null) {
+                URL.revokeObjectURL(partialUrl);
+                partialUrl = null;
+            }
+            if (e.data && e.data.partial) {
+                partialUrl = e.data.blobUrl;
+                if (onPartial) {
+                    onPartial(e.data.blobUrl);
+                }
+                return;
+            }
+            autosvgWasmWorker.removeEventListener('message', onMessage);
             resolve(e.data);
         });
     });
@@ -140,6 +166,7 @@ function App() {
     "output.svg"
   );
   const [isOutputSpinnerVisible, changeOutputSpinnerVisibility] = React.useState(false);
+  const [previewUrl, changePreviewUrl] = React.useState<string | null>(null);
 
   async function onFileChange(event: FormEvent<HTMLInputElement>) {
     // @ts-ignore
@@ -163,6 +190,7 @@ function App() {
         canvas.width = 600.0 * widthHeightRatio;
         canvas.height = 600.0;
         ctx.drawImage(dummyImg, 0, 0, canvas.width, canvas.height);
+        imageVersion++;
         resolve();
       };
       dummyImg.src = imageURL;
@@ -173,18 +201,24 @@ function App() {
 
   function handleConvert() {
     changeOutputSpinnerVisibility(true);
-    convertImageToSvg(memCanvas, kColor, sharpness)
+    // The preview fills in with the largest shapes while the rest is fitted.
+    convertImageToSvg(memCanvas, kColor, sharpness, changePreviewUrl)
     .then(result => {
         changeOutputSpinnerVisibility(false);
+        changePreviewUrl(null);
         if (!result) {
           return;
         }
+        if (svgBlob) {
+          URL.revokeObjectURL(svgBlob);
+        }
         changeBlobUrl(result.blobUrl);
         changeSvgContent(convertToJSON(result.svg));
         changeDownloadFileName(`${currentFileName}.svg`);
     })
     .catch(error => {
         changeOutputSpinnerVisibility(false);
+        changePreviewUrl(null);
     });
   }
 
@@ -238,6 +272,7 @@ function App() {
               <div className={s.loaderWrapper}
                   style={{display: isOutputSpinnerVisible? 'block': 'none'}}>
                   <Spinner size={100} />
+                  {previewUrl && <img src={previewUrl} alt="" width="100%"/>}
               </div>
               <div style={{display: !isOutputSpinnerVisible? 'block': 'none'}}>
                   {editor}
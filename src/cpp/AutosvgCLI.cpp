@@ -10,66 +10,222 @@
 #include <opencv2/highgui.hpp>
 #include <cxxopts.hpp>
 #include "AutosvgCLI.hpp"
+#include <cli/BatchConverter.hpp>
+#include <cli/ConversionServer.hpp>
+#include <cli/AllocationHooks.hpp>
+#include <core/PaletteMapper.hpp>
+#include <core/TiledConversion.hpp>
 #include <fstream>
+#include <thread>
 
 using namespace std;
 using namespace cv;
 
 namespace pi {
-      Pixel AutosvgCLI::getContourColor(const Contour &contour) {
-          cv::Mat image = cv::imread(this->inputFileName, IMREAD_COLOR);
-          return Operations::findContourAvgColor(image, contour);
+      string AutosvgCLI::convertToSvg(int kColors, int sharpness) {
+        BufferSink sink;
+        this->convertToSvg(sink, kColors, sharpness);
+        return std::move(sink.buffer);
       }
 
-      string AutosvgCLI::convertToSvg(int kColors, int sharpness) {
+      void AutosvgCLI::convertToSvg(SvgSink &sink, int kColors, int sharpness) {
+        ConversionOptions conversion = this->options;
+        conversion.colors = kColors;
+        conversion.sharpness = sharpness;
+
+        // A memory budget tiles the image, which the cache does not store.
+        if (this->stageCache && this->maxMemory == 0 && StageCache::caches(conversion)) {
+            this->convertCached(sink, conversion);
+            return;
+        }
+
         cv::Mat image;
-        image = cv::imread(this->inputFileName, IMREAD_COLOR);
-        auto img = new cv::Mat;
-        *img = image;
-        
-        auto ratio = img->rows/(img->cols * 1.0);
-        resize(*img, *img, cv::Size(600,600 * ratio), 0, 0);
-
-        SegmentedEdgeResult result = Operations::findColorSegmentedEdge(img, img, kColors);
-        const vector<Pixel> dominantColors = result.colors;
-        const vector<Contour> edges = result.edges;
-
-        vector<Pixel> colors;
-        for (auto contour: edges) {
-            colors.push_back(this->getContourColor(contour));
-        }
-        vector<Curve> curves = CurveUtils::convertContoursToBezierCurves(
-                edges,
-                sharpness,
-                colors
-        );
-        const vector<SVGParam> params = {
-                {"width",  to_string(img->cols).c_str()},
-                {"height", to_string(img->rows).c_str()},
-                {"xmlns",  "http://www.w3.org/2000/svg"}
-        };
-        string svg = CurveUtils::createSvgFromBezierCurves(curves, params);
-        return svg;
+        {
+            ProfileScope decode(conversion.profiler, "decode");
+            image = cv::imread(this->inputFileName, IMREAD_COLOR);
+            decode.items(image.total());
+        }
+        if (image.empty()) {
+            throw runtime_error("Unable to read image " + this->inputFileName);
+        }
+        if (this->maxMemory > 0) {
+            conversion.tileSize = TiledConversion::tileSizeForBudget(this->maxMemory, image.rows, image.cols,
+                                                                     image.channels());
+            conversion.memoryBudget = this->maxMemory;
+        }
+
+        AutosvgConverter(conversion, this->contexts).convert(image, BGR_FORMAT, sink);
+      }
+
+      void AutosvgCLI::convertCached(SvgSink &sink, const ConversionOptions &conversion) {
+        ifstream file(this->inputFileName, ios::binary);
+        if (!file) {
+            throw runtime_error("Unable to read image " + this->inputFileName);
+        }
+        const vector<char> content((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        const string key = StageCache::key(content, conversion);
+
+        AutosvgConverter converter(conversion, this->contexts);
+        ContextLease lease(*this->contexts);
+        ConversionContext &context = *lease.context;
+        cv::Size original, traced;
+        bool cached;
+        {
+            ProfileScope lookup(conversion.profiler, "cache");
+            cached = this->stageCache->load(key, context, original, traced);
+            lookup.items(cached ? 1 : 0);
+        }
 
+        if (!cached) {
+            cv::Mat image;
+            {
+                ProfileScope decode(conversion.profiler, "decode");
+                image = cv::imdecode(cv::Mat(1, int(content.size()), CV_8UC1, (void *) content.data()), IMREAD_COLOR);
+                decode.items(image.total());
+            }
+            if (image.empty()) {
+                throw runtime_error("Unable to read image " + this->inputFileName);
+            }
+            const cv::Mat img = converter.prepareImage(image, BGR_FORMAT, context);
+            converter.segment(img, nullptr, context);
+            original = image.size();
+            traced = img.size();
+            this->stageCache->store(key, context, original, traced);
+        }
+
+        if (conversion.progressiveBatch > 0) {
+            converter.writeSvgProgressively(context.segments.edges, conversion.sharpness, context.colors,
+                                            context.curves, original, traced, sink, context);
+            return;
+        }
+        converter.fit(context);
+        converter.writeSvg(context.curves, original, traced, sink, context);
       }
 
-      void AutosvgCLI::writeImage(const string fileName, const string svgContent) {
+      void AutosvgCLI::convertToFile(const string &fileName, int kColors, int sharpness) {
+        if (fileName == "-") {
+            OStreamSink sink(cout);
+            this->convertToSvg(sink, kColors, sharpness);
+            return;
+        }
+        ofstream file(fileName, ios::binary);
+        if (!file) {
+            throw runtime_error("Unable to write " + fileName);
+        }
+        try {
+            OStreamSink sink(file);
+            this->convertToSvg(sink, kColors, sharpness);
+        } catch (...) {
+            file.close();
+            remove(fileName.c_str());
+            throw;
+        }
+      }
+
+      int AutosvgCLI::parseColors(const string &value) {
+        if (value == "auto") {
+            return AUTO_K_COLORS;
+        }
+        size_t parsed = 0;
+        const int colors = stoi(value, &parsed);
+        if (parsed != value.size() || colors < 1 || colors > MAX_K_COLORS) {
+            throw invalid_argument("Invalid color count " + value);
+        }
+        return colors;
+      }
+
+      void AutosvgCLI::writeImage(const string &fileName, const string &svgContent) {
         ofstream file;
         file.open (fileName);
+        if (!file) {
+            throw runtime_error("Unable to write " + fileName);
+        }
         file << svgContent;
         file.close();
       }
 }
 
 
+static QuantizationEngine parseQuantizationEngine(const std::string &name) {
+  if (name == "kmeans") {
+    return KMEANS_QUANTIZATION;
+  }
+  if (name == "histogram") {
+    return HISTOGRAM_QUANTIZATION;
+  }
+  throw std::invalid_argument("Unknown quantizer " + name);
+}
+
+static TracingEngine parseTracingEngine(const std::string &name) {
+  if (name == "contours") {
+    return CONTOUR_TRACING;
+  }
+  if (name == "boundaries") {
+    return BOUNDARY_TRACING;
+  }
+  throw std::invalid_argument("Unknown tracer " + name);
+}
+
+static FittingMode parseFittingMode(const std::string &name) {
+  if (name == "adaptive") {
+    return ADAPTIVE_FITTING;
+  }
+  if (name == "simplified") {
+    return SIMPLIFIED_FITTING;
+  }
+  throw std::invalid_argument("Unknown fitting mode " + name);
+}
+
+static std::vector<cv::Vec3b> parsePalette(const std::string &value) {
+  ifstream file(value);
+  if (!file) {
+    return pi::PaletteMapper::parsePalette(value);
+  }
+  return pi::PaletteMapper::parsePalette(string(istreambuf_iterator<char>(file), istreambuf_iterator<char>()));
+}
+
+static void writeProfile(const pi::Profiler &profiler, const cxxopts::ParseResult &result) {
+  if (result.count("profile")) {
+    ofstream file(result["profile"].as<std::string>());
+    profiler.writeJson(file);
+  }
+  if (result.count("profile-trace")) {
+    ofstream file(result["profile-trace"].as<std::string>());
+    profiler.writeChromeTrace(file);
+  }
+}
+
 int main(int argc, char **argv) {
   cxxopts::Options options("autosvg", "Tracing tool which can convert any jpg or png into svg");
 
   options.add_options()
     ("i,input", "Input Filename", cxxopts::value<std::string>())
-    ("o,output", "Output Filename", cxxopts::value<std::string>()->default_value("out.svg"))
-    ("k,colors", "Color Details", cxxopts::value<int>()->default_value("3"))
+    ("o,output", "Output Filename, - writes to stdout", cxxopts::value<std::string>()->default_value("out.svg"))
+    ("k,colors", "Color Details, auto picks the count per image", cxxopts::value<std::string>()->default_value("3"))
     ("s,smoothness", "Smoothness Index", cxxopts::value<int>()->default_value("5"))
+    ("palette", "Fixed colors to map pixels to instead of quantizing: hex colors separated by commas, or a file of them", cxxopts::value<std::string>())
+    ("learn-palette", "Batch mode: learn one palette from this many images spread over the batch and use it for every image", cxxopts::value<size_t>())
+    ("q,quantizer", "Color quantizer: histogram or kmeans", cxxopts::value<std::string>()->default_value("histogram"))
+    ("t,tracer", "Region tracer: boundaries (single pass) or contours (findContours per color)", cxxopts::value<std::string>()->default_value("boundaries"))
+    ("f,fitting", "Curve fitting: adaptive (smoothness is the maximum error in pixels) or simplified (one cubic per polygon edge)", cxxopts::value<std::string>()->default_value("adaptive"))
+    ("p,precision", "Decimal places of path coordinates", cxxopts::value<int>()->default_value(to_string(PATH_DATA_PRECISION)))
+    ("absolute", "Write absolute path commands instead of relative ones")
+    ("w,width", "Width images are traced at, wider ones are downscaled, 0 keeps their size", cxxopts::value<int>()->default_value(to_string(CONVERSION_WIDTH)))
+    ("progressive", "Write the svg while fitting, largest shapes first, flushing after this many curves and then batches twice as large", cxxopts::value<size_t>()->implicit_value(to_string(PROGRESSIVE_FIRST_BATCH)))
+    ("pyramid", "Segment at --width and refine region boundaries at full resolution")
+    ("tile-size", "Trace the image in square tiles of this many pixels at full resolution", cxxopts::value<int>())
+    ("max-memory", "Memory budget in MB, traces at full resolution in tiles sized to fit it", cxxopts::value<size_t>())
+    ("b,batch", "Batch input: a directory, a glob pattern or a manifest file with one image per line", cxxopts::value<std::string>())
+    ("d,output-dir", "Output directory for batch mode", cxxopts::value<std::string>()->default_value("."))
+    ("j,jobs", "Worker threads for batch mode", cxxopts::value<unsigned int>()->default_value(to_string(max(1u, thread::hardware_concurrency()))))
+    ("cache", "Directory of an on-disk cache of segmentations, reconverting an image with other fitting or output settings skips decoding, quantization and tracing", cxxopts::value<std::string>())
+    ("cache-size", "Size limit of the cache in MB, least recently used entries are removed beyond it", cxxopts::value<size_t>()->default_value(to_string(STAGE_CACHE_SIZE)))
+    ("serve", "Run as a server converting JSON-lines jobs from this Unix domain socket, or from stdin with -", cxxopts::value<std::string>())
+    ("watch", "Run as a server converting every image that appears in this directory into --output-dir", cxxopts::value<std::string>())
+    ("queue-size", "Server jobs queued ahead of the workers before inputs block", cxxopts::value<size_t>()->default_value(to_string(SERVER_QUEUE_SIZE)))
+    ("metrics-port", "Serve Prometheus metrics of the server over http on this localhost port", cxxopts::value<int>())
+    ("profile", "Write per stage wall time, cpu time, allocations and item counts as JSON to this file", cxxopts::value<std::string>())
+    ("profile-trace", "Write the same stages as Chrome trace events to this file", cxxopts::value<std::string>())
     ("h,help", "Print Usage");
 
   try {
@@ -81,17 +237,116 @@ int main(int argc, char **argv) {
         exit(0);
     }
 
+    const int colors = pi::AutosvgCLI::parseColors(result["colors"].as<std::string>());
     pi::AutosvgCLI inst;
+    inst.options.quantizer = parseQuantizationEngine(result["quantizer"].as<std::string>());
+    inst.options.tracer = parseTracingEngine(result["tracer"].as<std::string>());
+    inst.options.fitting = parseFittingMode(result["fitting"].as<std::string>());
+    inst.options.pathData.precision = result["precision"].as<int>();
+    inst.options.pathData.relative = result.count("absolute") == 0;
+    inst.options.width = max(result["width"].as<int>(), 0);
+    inst.options.pyramid = result.count("pyramid") > 0;
+    if (result.count("palette")) {
+        inst.options.palette = parsePalette(result["palette"].as<std::string>());
+    }
+    if (result.count("progressive")) {
+        inst.options.progressiveBatch = max(result["progressive"].as<size_t>(), size_t(1));
+    }
+    if (result.count("tile-size")) {
+        inst.options.tileSize = max(result["tile-size"].as<int>(), MIN_TILE_SIZE);
+    }
+    if (result.count("max-memory")) {
+        inst.maxMemory = result["max-memory"].as<size_t>() << 20;
+    }
+    if (result.count("cache")) {
+        inst.stageCache = std::make_shared<pi::StageCache>(result["cache"].as<std::string>(),
+                                                           result["cache-size"].as<size_t>() << 20);
+    }
+
+    pi::Profiler profiler;
+    const bool profiling = result.count("profile") || result.count("profile-trace");
+    if (profiling) {
+        pi::enableAllocationCounting();
+        inst.options.profiler = &profiler;
+    }
+
+    if (result.count("serve") || result.count("watch")) {
+        pi::ConversionServer server(result["jobs"].as<unsigned int>(), result["queue-size"].as<size_t>());
+        // Jobs are profiled one by one for the metrics.
+        inst.options.profiler = nullptr;
+        server.settings = inst;
+        server.outputDirectory = result["output-dir"].as<std::string>();
+        server.colors = colors;
+        server.sharpness = result["smoothness"].as<int>();
+        if (result.count("metrics-port")) {
+            server.serveMetrics(result["metrics-port"].as<int>());
+        }
+
+        if (!result.count("serve")) {
+            server.watch(result["watch"].as<std::string>());
+        }
+        std::thread watcher;
+        if (result.count("watch")) {
+            watcher = std::thread(&pi::ConversionServer::watch, &server, result["watch"].as<std::string>());
+        }
+        const auto socketPath = result["serve"].as<std::string>();
+        if (socketPath == "-") {
+            server.serveStream(std::cin, std::cout);
+        } else {
+            try {
+                server.serveSocket(socketPath);
+            } catch (...) {
+                // The error ends the process, not a joinable thread's destructor.
+                if (watcher.joinable()) {
+                    watcher.detach();
+                }
+                throw;
+            }
+        }
+        if (watcher.joinable()) {
+            watcher.join();
+        }
+        return 0;
+    }
+
+    if (result.count("batch")) {
+        pi::BatchConverter batch;
+        batch.outputDirectory = result["output-dir"].as<std::string>();
+        batch.jobs = result["jobs"].as<unsigned int>();
+        batch.settings = inst;
+
+        auto inputs = pi::BatchConverter::resolveInputs(result["batch"].as<std::string>());
+        if (result.count("learn-palette") && inst.options.palette.empty()) {
+            batch.settings.options.palette = batch.learnPalette(inputs, result["learn-palette"].as<size_t>(),
+                                                                colors);
+        }
+        auto report = batch.run(inputs, colors, result["smoothness"].as<int>());
+
+        auto imagesPerSecond = report.seconds > 0 ? report.converted / report.seconds : 0;
+        std::cout << "Converted " << report.converted << "/" << inputs.size() << " images in "
+                  << report.seconds << "s (" << imagesPerSecond << " images/sec, "
+                  << batch.jobs << " jobs), " << report.failures.size() << " failed" << std::endl;
+        if (profiling) {
+            writeProfile(profiler, result);
+        }
+        return report.failures.empty() ? 0 : 1;
+    }
+
     inst.inputFileName = result["input"].as<std::string>();
     inst.outputFileName = result["output"].as<std::string>();
 
-    
-    auto svgContent = inst.convertToSvg(result["colors"].as<int>(), result["smoothness"].as<int>());  
-    inst.writeImage(inst.outputFileName, svgContent);
+    inst.convertToFile(inst.outputFileName, colors, result["smoothness"].as<int>());
+    if (profiling) {
+        writeProfile(profiler, result);
+    }
 
+  } catch(const cxxopts::exceptions::exception& e) {
+    // Only a malformed command line gets the usage, on stderr so that it never ends up in `-o -`.
+    std::cerr << e.what() << std::endl << options.help() << std::endl;
+    return 1;
   } catch(const std::exception& e) {
-    std::cout << options.help() << std::endl;
-    exit(0);
+    std::cerr << "autosvg: " << e.what() << std::endl;
+    return 1;
   }
   return 0;
 }
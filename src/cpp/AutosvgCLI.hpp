@@ -7,25 +7,55 @@
 #define AUTOSVG_AUTOSVG_HPP
 
 #include <iostream>
+#include <memory>
 #include <string>
 #include <opencv2/opencv.hpp>
 
-#include <utils/CurveUtils.hpp>
+#include <utils/SvgWriter.hpp>
+#include <utils/Profiler.hpp>
 #include <utils/Constants.hpp>
-#include <core/Operations.hpp>
+#include <core/AutosvgConverter.hpp>
+#include <cli/StageCache.hpp>
 
 using namespace cv;
 using namespace std;
 
 namespace pi {
     class AutosvgCLI {
-    private:
-        Pixel getContourColor(const Contour& contour);
     public:
         string inputFileName;
         string outputFileName;
+        /**
+         * Colors and sharpness are taken from the convert calls.
+         */
+        ConversionOptions options;
+        /**
+         * Scratch buffers, shared by copies of this instance so batch workers
+         * reuse them between images.
+         */
+        std::shared_ptr<ContextPool> contexts = std::make_shared<ContextPool>();
+        /**
+         * Memory budget in bytes, when set the tile size is chosen per image
+         * to stay within it and conversions that outgrow it fail.
+         */
+        size_t maxMemory = 0;
+        /**
+         * When set, whole image conversions load their segmentation from it
+         * or store it there, see StageCache.
+         */
+        std::shared_ptr<StageCache> stageCache;
         std::string convertToSvg(int k_colors, int sharpness);
-        void writeImage(const string fileName, const string svgContent);
+        void convertToSvg(SvgSink &sink, int k_colors, int sharpness);
+        void convertToFile(const string &fileName, int k_colors, int sharpness);
+        void writeImage(const string &fileName, const string &svgContent);
+
+        /**
+         * A color count option: a number, or "auto" for AUTO_K_COLORS.
+         */
+        static int parseColors(const string &value);
+
+    private:
+        void convertCached(SvgSink &sink, const ConversionOptions &conversion);
     };
 }
 
@@ -2,54 +2,114 @@
 // Created by Anuj Kosambi on 12/05/20.
 //
 
-#include <core/Operations.hpp>
 #include "AutosvgWASM.hpp"
-#include <utils/CurveUtils.hpp>
 
 using namespace std;
 using namespace cv;
 using namespace emscripten;
 
 namespace pi {
+    static ConversionOptions sessionOptions() {
+        // The page already scales its canvas, images are traced at their size.
+        ConversionOptions options;
+        options.width = 0;
+        return options;
+    }
+
+    AutosvgWASM::AutosvgWASM() : session(sessionOptions()) {
+    }
+
+    uintptr_t AutosvgWASM::imageBuffer(int rows, int cols) {
+        pixels.resize(size_t(max(rows, 0)) * max(cols, 0) * 4);
+        loadImage(reinterpret_cast<uintptr_t>(pixels.data()), rows, cols);
+        return reinterpret_cast<uintptr_t>(pixels.data());
+    }
+
     void AutosvgWASM::loadImage(uintptr_t buffer, int rows, int cols) {
-        try {
-            imagePixels = reinterpret_cast<unsigned int *>(buffer);
-            img = new cv::Mat(rows, cols, CV_8UC4, imagePixels);
-            cv::cvtColor(*img, *img, COLOR_RGBA2RGB);
-        } catch (const char *message) {
-            cout << "Error in loading image : %s" << message << endl;
+        // Only wraps the pixels, the session reads RGBA directly on the next conversion.
+        imagePixels = reinterpret_cast<unsigned char *>(buffer);
+        img = cv::Mat(rows, cols, CV_8UC4, imagePixels);
+        imageChanged = true;
+    }
+
+    bool AutosvgWASM::hasImage() const {
+        return imageChanged || session.hasImage();
+    }
+
+    /**
+     * Collects the document like BufferSink and passes everything written
+     * since the last flush to a JavaScript callback.
+     */
+    class CallbackSink : public BufferSink {
+    public:
+        explicit CallbackSink(val callback) : callback(callback) {}
+
+        void flush() override {
+            if (buffer.size() > forwarded) {
+                callback(buffer.substr(forwarded));
+                forwarded = buffer.size();
+            }
         }
+
+    private:
+        val callback;
+        size_t forwarded = 0;
+    };
+
+    string AutosvgWASM::convert(int kColors, int sharpness, bool edgePreview) {
+        BufferSink sink;
+        session.setProgressiveBatch(0);
+        convert(kColors, sharpness, edgePreview, sink);
+        return std::move(sink.buffer);
     }
 
-    Pixel AutosvgWASM::getContourColor(const Contour &contour) {
-        auto orig = new cv::Mat(img->rows, img->cols, CV_8UC4, imagePixels);
-        cv::cvtColor(*orig, *orig, COLOR_RGBA2RGB);
-        return Operations::findContourAvgColor(*orig, contour);
+    string AutosvgWASM::convertProgressively(int kColors, int sharpness, bool edgePreview, val onChunk) {
+        CallbackSink sink(onChunk);
+        session.setProgressiveBatch(PROGRESSIVE_FIRST_BATCH);
+        convert(kColors, sharpness, edgePreview, sink);
+        return std::move(sink.buffer);
     }
 
-    string AutosvgWASM::convertToSvg(int kColors, int sharpness) {
-        SegmentedEdgeResult result = Operations::findColorSegmentedEdge(img, img, kColors);
+    void AutosvgWASM::convert(int kColors, int sharpness, bool edgePreview, SvgSink &sink) {
+        if (imageChanged) {
+            session.setImage(img, RGBA_FORMAT);
+            imageChanged = false;
+            // The session keeps its own copy, so the worker's buffer is not held
+            // as a second one between jobs. Caller owned pixels are left alone.
+            if (imagePixels == pixels.data()) {
+                img = cv::Mat();
+                imagePixels = nullptr;
+                vector<unsigned char>().swap(pixels);
+            }
+        }
 
-        const vector<Pixel> dominantColors = result.colors;
-        const vector<Contour> edges = result.edges;
+        cv::Mat edgeImage;
+        session.convert(kColors, sharpness, sink, edgePreview ? &edgeImage : nullptr);
 
-        vector<Pixel> colors;
-        for (auto contour: edges) {
-            colors.push_back(this->getContourColor(contour));
+        if (edgePreview) {
+            // The pixels may have been released since the image was loaded.
+            if (imagePixels == nullptr) {
+                pixels.resize(edgeImage.total() * 4);
+                imagePixels = pixels.data();
+            }
+            cv::Mat preview(edgeImage.rows, edgeImage.cols, CV_8UC4, imagePixels);
+            cv::cvtColor(edgeImage, preview, COLOR_RGB2RGBA);
         }
-        vector<Curve> curves = CurveUtils::convertContoursToBezierCurves(
-                edges,
-                sharpness,
-                colors
-        );
-        const vector<SVGParam> params = {
-                {"width",  to_string(img->cols).c_str()},
-                {"height", to_string(img->rows).c_str()},
-                {"xmlns",  "http://www.w3.org/2000/svg"}
-        };
-        string svg = CurveUtils::createSvgFromBezierCurves(curves, params);
-        cv::cvtColor(*img, *img, COLOR_RGB2RGBA);
-        memcpy(imagePixels, img->data, img->rows * img->cols * sizeof(int));
-        return svg;
-    }
-}
\ No newline at end of file
+    }
+
+    uintptr_t AutosvgWASM::pixelBuffer() const {
+        return reinterpret_cast<uintptr_t>(imagePixels);
+    }
+
+    string AutosvgWASM::convertToSvg(int kColors, int sharpness) {
+        return convert(kColors, sharpness, true);
+    }
+
+    void AutosvgWASM::releaseScratch() {
+        img = cv::Mat();
+        imagePixels = nullptr;
+        imageChanged = false;
+        vector<unsigned char>().swap(pixels);
+        session.clearCache();
+    }
+}
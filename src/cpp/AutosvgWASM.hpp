@@ -9,26 +9,94 @@
 #include <emscripten/bind.h>
 #include <iostream>
 #include <string>
+#include <vector>
 #include <opencv2/opencv.hpp>
+#include <core/AutosvgConverter.hpp>
+#include <core/ConversionSession.hpp>
 
 namespace pi {
+    /**
+     * Converter kept alive by the web worker for all of its jobs.
+     *
+     * The worker copies each image's RGBA pixels straight into the buffer
+     * returned by imageBuffer(). The image is prepared once when it is first
+     * converted, which leaves the session's copy as the only one, and later
+     * conversions with other parameters reuse the stages of the session that
+     * they do not change.
+     */
     class AutosvgWASM {
     private:
-        cv::Mat *img;
-        unsigned int *imagePixels;
-        Pixel getContourColor(const Contour& contour);
+        std::vector<unsigned char> pixels;
+        cv::Mat img;
+        unsigned char *imagePixels = nullptr;
+        bool imageChanged = false;
+        ConversionSession session;
+
+        void convert(int kColors, int sharpness, bool edgePreview, SvgSink &sink);
     public:
+        AutosvgWASM();
+
+        /**
+         * Returns the address of an RGBA buffer for a `rows` x `cols` image and
+         * makes it the loaded image. The buffer is freed once the next
+         * conversion copied the image into its session. Allocating it may grow
+         * the heap, so callers must take a fresh view of HEAPU8 afterwards.
+         */
+        uintptr_t imageBuffer(int rows, int cols);
+
+        /**
+         * Loads RGBA pixels owned by the caller, which must stay valid until
+         * the conversion finished.
+         */
         void loadImage(uintptr_t buffer, int rows, int cols);
 
+        /**
+         * Whether an image was loaded, so that convert() may be called
+         * without loading it again.
+         */
+        bool hasImage() const;
+
+        /**
+         * Converts the loaded image. With `edgePreview` the traced edges are
+         * written as RGBA pixels into the buffer at pixelBuffer().
+         */
+        std::string convert(int kColors, int sharpness, bool edgePreview);
+
+        /**
+         * Same as convert(), writing the svg while its curves are fitted.
+         * `onChunk` is called with each flushed part, the header first and
+         * then batches of paths largest first, before the rest is fitted.
+         * Returns the whole document.
+         */
+        std::string convertProgressively(int kColors, int sharpness, bool edgePreview, emscripten::val onChunk);
+
+        uintptr_t pixelBuffer() const;
+
+        /**
+         * Same as convert() with the edge preview, kept for existing callers.
+         */
         std::string convertToSvg(int k_colors, int sharpness);
+
+        /**
+         * Frees the image buffer, the cached stages and the conversion scratch
+         * memory, e.g. once the worker went idle. The prepared image is kept,
+         * so it can still be converted without loading it again.
+         */
+        void releaseScratch();
     };
 }
 
 EMSCRIPTEN_BINDINGS() {
     emscripten::class_<pi::AutosvgWASM>("AutosvgWASM")
             .constructor()
+            .function("imageBuffer", &pi::AutosvgWASM::imageBuffer)
             .function("loadImage", &pi::AutosvgWASM::loadImage)
-            .function("convertToSvg", &pi::AutosvgWASM::convertToSvg);
+            .function("hasImage", &pi::AutosvgWASM::hasImage)
+            .function("pixelBuffer", &pi::AutosvgWASM::pixelBuffer)
+            .function("convert", emscripten::select_overload<std::string(int, int, bool)>(&pi::AutosvgWASM::convert))
+            .function("convertProgressively", &pi::AutosvgWASM::convertProgressively)
+            .function("convertToSvg", &pi::AutosvgWASM::convertToSvg)
+            .function("releaseScratch", &pi::AutosvgWASM::releaseScratch);
 }
 
 #endif //AUTOSVG_AUTOSVG_HPP
@@ -0,0 +1,73 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include <utils/Profiler.hpp>
+#include "AllocationHooks.hpp"
+
+static std::atomic<bool> counting(false);
+static std::atomic<size_t> allocationCount(0);
+static std::atomic<size_t> allocationBytes(0);
+
+static void *countedAllocation(size_t size) {
+    if (counting.load(std::memory_order_relaxed)) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    return std::malloc(size ? size : 1);
+}
+
+static void readAllocationCounters(size_t *count, size_t *bytes) {
+    const pi::AllocationStats stats = pi::allocationStats();
+    *count = stats.count;
+    *bytes = stats.bytes;
+}
+
+void *operator new(size_t size) {
+    void *memory = countedAllocation(size);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return countedAllocation(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return countedAllocation(size);
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept {
+    std::free(memory);
+}
+
+namespace pi {
+    void enableAllocationCounting() {
+        counting.store(true, std::memory_order_relaxed);
+        Profiler::allocationReader = readAllocationCounters;
+    }
+
+    AllocationStats allocationStats() {
+        AllocationStats stats = {allocationCount.load(std::memory_order_relaxed),
+                                 allocationBytes.load(std::memory_order_relaxed)};
+        return stats;
+    }
+}
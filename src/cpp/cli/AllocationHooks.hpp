@@ -0,0 +1,29 @@
+#ifndef AUTOSVG_CLI_ALLOCATIONHOOKS_HPP
+#define AUTOSVG_CLI_ALLOCATIONHOOKS_HPP
+
+#include <cstddef>
+
+namespace pi {
+
+    struct AllocationStats {
+        size_t count;
+        size_t bytes;
+    };
+
+    /**
+     * Programs linking this file, the cli and the benchmarks, replace the
+     * global operator new so that heap traffic can be reported. It is never
+     * part of libautosvg. Counting stays off, at the cost of one relaxed load
+     * per allocation, until it is enabled; enabling also installs the
+     * counters as Profiler::allocationReader.
+     */
+    void enableAllocationCounting();
+
+    /**
+     * Totals of every operator new call since counting was enabled. OpenCV
+     * buffers go through cv::fastMalloc and are not included.
+     */
+    AllocationStats allocationStats();
+}
+
+#endif //AUTOSVG_CLI_ALLOCATIONHOOKS_HPP
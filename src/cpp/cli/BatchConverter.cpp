@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <core/ColorQuantizer.hpp>
+#include <utils/WorkerPool.hpp>
+#include "BatchConverter.hpp"
+
+using namespace std;
+
+namespace pi {
+    static const vector<string> IMAGE_EXTENSIONS = {
+            ".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff", ".webp", ".ppm", ".pgm"
+    };
+
+    static string lowercase(string value) {
+        transform(value.begin(), value.end(), value.begin(), ::tolower);
+        return value;
+    }
+
+    static bool isImageFile(const string &fileName) {
+        auto dot = fileName.find_last_of('.');
+        if (dot == string::npos) {
+            return false;
+        }
+        auto extension = lowercase(fileName.substr(dot));
+        return find(IMAGE_EXTENSIONS.begin(), IMAGE_EXTENSIONS.end(), extension) != IMAGE_EXTENSIONS.end();
+    }
+
+    static bool isDirectory(const string &path) {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+    }
+
+    static vector<string> listDirectory(const string &directory) {
+        vector<string> files;
+        DIR *dir = opendir(directory.c_str());
+        if (dir == nullptr) {
+            throw runtime_error("Unable to open directory " + directory);
+        }
+        while (struct dirent *entry = readdir(dir)) {
+            string name = entry->d_name;
+            if (name[0] == '.' || !isImageFile(name)) {
+                continue;
+            }
+            auto path = directory.back() == '/' ? directory + name : directory + "/" + name;
+            if (!isDirectory(path)) {
+                files.push_back(path);
+            }
+        }
+        closedir(dir);
+        sort(files.begin(), files.end());
+        return files;
+    }
+
+    static vector<string> expandGlob(const string &pattern) {
+        vector<string> files;
+        glob_t matches;
+        if (glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; i++) {
+                if (!isDirectory(matches.gl_pathv[i])) {
+                    files.emplace_back(matches.gl_pathv[i]);
+                }
+            }
+        }
+        globfree(&matches);
+        return files;
+    }
+
+    static vector<string> readManifest(const string &manifest) {
+        ifstream file(manifest);
+        if (!file) {
+            throw runtime_error("Unable to read manifest " + manifest);
+        }
+        vector<string> files;
+        string line;
+        while (getline(file, line)) {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            line.erase(0, line.find_first_not_of(" \t"));
+            if (!line.empty() && line[0] != '#') {
+                files.push_back(line);
+            }
+        }
+        return files;
+    }
+
+    vector<string> BatchConverter::resolveInputs(const string &source) {
+        if (isDirectory(source)) {
+            return listDirectory(source);
+        }
+        if (source.find_first_of("*?[") != string::npos) {
+            return expandGlob(source);
+        }
+        return readManifest(source);
+    }
+
+    string BatchConverter::outputFileNameFor(const string &inputFileName, const string &outputDirectory,
+                                             bool keepExtension, unsigned int copy) {
+        auto slash = inputFileName.find_last_of('/');
+        auto baseName = slash == string::npos ? inputFileName : inputFileName.substr(slash + 1);
+        auto dot = baseName.find_last_of('.');
+        if (dot != string::npos && dot > 0 && !keepExtension) {
+            baseName = baseName.substr(0, dot);
+        }
+        if (copy > 1) {
+            baseName += "-" + to_string(copy);
+        }
+        if (outputDirectory.empty()) {
+            return baseName + ".svg";
+        }
+        auto separator = outputDirectory.back() == '/' ? "" : "/";
+        return outputDirectory + separator + baseName + ".svg";
+    }
+
+    vector<string> BatchConverter::outputFileNamesFor(const vector<string> &inputs, const string &outputDirectory) {
+        map<string, size_t> sharedNames;
+        for (const auto &input : inputs) {
+            sharedNames[BatchConverter::outputFileNameFor(input, outputDirectory)]++;
+        }
+
+        // Every first choice is reserved up front, so a numbered copy never
+        // takes the name of an input further down the list.
+        vector<string> names;
+        set<string> firstChoices;
+        for (const auto &input : inputs) {
+            auto name = BatchConverter::outputFileNameFor(input, outputDirectory);
+            if (sharedNames[name] > 1) {
+                name = BatchConverter::outputFileNameFor(input, outputDirectory, true);
+            }
+            names.push_back(name);
+            firstChoices.insert(name);
+        }
+
+        set<string> written;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            // Same name and extension in another directory, e.g. a/x.png and b/x.png.
+            if (written.count(names[i])) {
+                unsigned int copy = 2;
+                do {
+                    names[i] = BatchConverter::outputFileNameFor(inputs[i], outputDirectory, true, copy++);
+                } while (written.count(names[i]) || firstChoices.count(names[i]));
+            }
+            written.insert(names[i]);
+        }
+        return names;
+    }
+
+    vector<cv::Vec3b> BatchConverter::learnPalette(const vector<string> &inputs, size_t samples,
+                                                    int kColors) const {
+        samples = min(samples, inputs.size());
+        if (samples == 0) {
+            throw invalid_argument("No images to learn a palette from");
+        }
+
+        // One histogram over every sample, each weighted by its pixel count
+        // at the working width. Resized and converted here rather than by
+        // prepareImage, which leaves tiled images as decoded, so the palette
+        // is RGB for every pipeline.
+        const int width = settings.options.width;
+        ConversionContext context;
+        ColorQuantizer::clearHistogram(context.histogram);
+        size_t sampled = 0;
+        for (size_t i = 0; i < samples; i++) {
+            const auto &input = inputs[i * inputs.size() / samples];
+            const cv::Mat image = cv::imread(input, cv::IMREAD_COLOR);
+            if (image.empty()) {
+                cerr << "Skipping palette sample " << input << endl;
+                continue;
+            }
+            cv::Mat sample = image;
+            if (width > 0 && image.cols > width) {
+                const int height = max(1, int(image.rows * (width / double(image.cols))));
+                cv::resize(image, context.resized, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+                sample = context.resized;
+            }
+            cv::cvtColor(sample, context.rgb, cv::COLOR_BGR2RGB);
+            ColorQuantizer::accumulateHistogram(context.rgb, context.histogram);
+            sampled++;
+        }
+        if (sampled == 0) {
+            throw runtime_error("Unable to read any palette sample");
+        }
+        ColorQuantizer::collectHistogram(context.histogram);
+        return ColorQuantizer::histogramPalette(context.histogram.histogram, kColors);
+    }
+
+    BatchReport BatchConverter::run(const vector<string> &inputs, int kColors, int sharpness) {
+        BatchReport report;
+        mutex reportLock;
+
+        if (!outputDirectory.empty() && !isDirectory(outputDirectory) &&
+            mkdir(outputDirectory.c_str(), 0755) != 0) {
+            throw runtime_error("Unable to create output directory " + outputDirectory);
+        }
+
+        // Every worker already runs a whole conversion, so OpenCV's own
+        // thread pool would only oversubscribe the cores.
+        if (jobs > 1) {
+            cv::setNumThreads(1);
+        }
+
+        // Decided before any job runs, so that no svg silently replaces another.
+        const auto outputs = BatchConverter::outputFileNamesFor(inputs, outputDirectory);
+
+        auto start = chrono::steady_clock::now();
+        {
+            WorkerPool pool(jobs);
+            for (size_t i = 0; i < inputs.size(); i++) {
+                const auto &input = inputs[i];
+                const auto &output = outputs[i];
+                pool.submit([this, &input, &output, &report, &reportLock, kColors, sharpness]() {
+                    try {
+                        AutosvgCLI inst = settings;
+                        inst.inputFileName = input;
+                        inst.outputFileName = output;
+                        inst.convertToFile(inst.outputFileName, kColors, sharpness);
+
+                        lock_guard<mutex> guard(reportLock);
+                        report.converted++;
+                    } catch (const exception &e) {
+                        lock_guard<mutex> guard(reportLock);
+                        report.failures.push_back({input, e.what()});
+                        cerr << "Failed to convert " << input << " : " << e.what() << endl;
+                    }
+                });
+            }
+            pool.wait();
+        }
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return report;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef AUTOSVG_CLI_BATCHCONVERTER_HPP
+#define AUTOSVG_CLI_BATCHCONVERTER_HPP
+
+#include <string>
+#include <vector>
+#include <AutosvgCLI.hpp>
+
+using namespace std;
+
+namespace pi {
+
+    struct BatchFailure {
+        string inputFileName;
+        string reason;
+    };
+
+    struct BatchReport {
+        unsigned long converted = 0;
+        vector<BatchFailure> failures;
+        double seconds = 0;
+    };
+
+    class BatchConverter {
+    public:
+        string outputDirectory = ".";
+        unsigned int jobs = 1;
+        /**
+         * Conversion settings shared by every job; file names are set per input.
+         */
+        AutosvgCLI settings;
+
+        /**
+         * Expands a batch source into input files. The source can be a
+         * directory (every image inside it), a glob pattern, or a manifest
+         * file listing one input path per line.
+         */
+        static vector<string> resolveInputs(const string &source);
+
+        /**
+         * The svg written for an input: its name without the extension, or
+         * with it when `keepExtension` is set, so that `x.png` and `x.jpg`
+         * can be told apart. A `copy` above 1 is appended, e.g. `x.png-2.svg`.
+         */
+        static string outputFileNameFor(const string &inputFileName, const string &outputDirectory,
+                                        bool keepExtension = false, unsigned int copy = 1);
+
+        /**
+         * The svg of every input, keeping the extension of inputs that share
+         * their name without it. Later inputs whose svg is still written for
+         * an earlier one, e.g. `b/x.png` after `a/x.png`, are numbered from 2.
+         */
+        static vector<string> outputFileNamesFor(const vector<string> &inputs, const string &outputDirectory);
+
+        BatchReport run(const vector<string> &inputs, int kColors, int sharpness);
+
+        /**
+         * Quantizes up to `samples` images spread evenly over `inputs`, at the
+         * working width of `settings`, into one palette of `kColors` colors.
+         * Setting it as `settings.options.palette` keeps the colors of the
+         * whole batch consistent and skips clustering per image.
+         */
+        vector<cv::Vec3b> learnPalette(const vector<string> &inputs, size_t samples, int kColors) const;
+    };
+}
+
+#endif //AUTOSVG_CLI_BATCHCONVERTER_HPP
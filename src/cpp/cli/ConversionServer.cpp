@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <opencv2/core.hpp>
+#include "BatchConverter.hpp"
+#include "ConversionServer.hpp"
+
+using namespace std;
+
+namespace pi {
+
+    /**
+     * Where the answers of one client go. Shared by the client's reader and
+     * its queued jobs, the socket is closed once the last of them is done.
+     */
+    class ResponseChannel {
+    public:
+        explicit ResponseChannel(int socket) : socket(socket) {}
+
+        explicit ResponseChannel(ostream &stream) : stream(&stream) {}
+
+        ~ResponseChannel() {
+            if (socket >= 0) {
+                close(socket);
+            }
+        }
+
+        void send(const string &line) {
+            lock_guard<std::mutex> lock(mutex);
+            if (stream) {
+                *stream << line << "\n" << flush;
+                return;
+            }
+            const string message = line + "\n";
+            for (size_t sent = 0; sent < message.size();) {
+                const auto written = write(socket, message.data() + sent, message.size() - sent);
+                if (written <= 0) {
+                    // The client is gone, its remaining answers are dropped.
+                    return;
+                }
+                sent += size_t(written);
+            }
+        }
+
+    private:
+        int socket = -1;
+        ostream *stream = nullptr;
+        std::mutex mutex;
+    };
+
+    static string jsonString(const string &value) {
+        string quoted = "\"";
+        for (char c : value) {
+            switch (c) {
+                case '"':
+                    quoted += "\\\"";
+                    break;
+                case '\\':
+                    quoted += "\\\\";
+                    break;
+                case '\n':
+                    quoted += "\\n";
+                    break;
+                default:
+                    if ((unsigned char) c < 0x20) {
+                        char escaped[7];
+                        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        quoted += escaped;
+                    } else {
+                        quoted += c;
+                    }
+            }
+        }
+        return quoted + "\"";
+    }
+
+    static string errorResponse(const string &id, const string &reason) {
+        return "{\"id\": " + jsonString(id) + ", \"status\": \"error\", \"error\": " + jsonString(reason) + "}";
+    }
+
+    /**
+     * Whether accept() may succeed again after failing with `error`. Running
+     * out of descriptors or memory waits ACCEPT_RETRY_MS first, so the loop
+     * does not spin until connections close.
+     */
+    static bool acceptCanRetry(int error) {
+        switch (error) {
+            case EINTR:
+            case ECONNABORTED:
+            case EPROTO:
+                return true;
+            case EMFILE:
+            case ENFILE:
+            case ENOBUFS:
+            case ENOMEM:
+                this_thread::sleep_for(chrono::milliseconds(ACCEPT_RETRY_MS));
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    ConversionServer::ConversionServer(unsigned int jobs, size_t queueSize)
+            : queueSize(queueSize), pool(jobs, queueSize) {
+        // Every worker already runs a whole conversion, see BatchConverter.
+        if (jobs > 1) {
+            cv::setNumThreads(1);
+        }
+        // Writing to a client that hung up must not end the server.
+        signal(SIGPIPE, SIG_IGN);
+    }
+
+    void ConversionServer::submit(const string &line, const shared_ptr<ResponseChannel> &channel) {
+        const auto start = line.find_first_not_of(" \t\r");
+        if (start == string::npos) {
+            return;
+        }
+
+        ServerJob job;
+        job.colors = colors;
+        job.sharpness = sharpness;
+        if (line[start] != '{') {
+            job.input = line.substr(start, line.find_last_not_of(" \t\r") + 1 - start);
+            submit(job, channel);
+            return;
+        }
+
+        try {
+            boost::property_tree::ptree request;
+            istringstream stream(line);
+            boost::property_tree::read_json(stream, request);
+            job.id = request.get<string>("id", "");
+            job.input = request.get<string>("input");
+            job.output = request.get<string>("output", "");
+            const auto requested = request.get_optional<string>("colors");
+            if (requested) {
+                job.colors = AutosvgCLI::parseColors(*requested);
+            }
+            job.sharpness = request.get<int>("smoothness", sharpness);
+        } catch (const exception &e) {
+            channel->send(errorResponse(job.id, string("Invalid request: ") + e.what()));
+            return;
+        }
+        submit(job, channel);
+    }
+
+    void ConversionServer::submit(const ServerJob &job, const shared_ptr<ResponseChannel> &channel) {
+        pool.submit([this, job, channel]() {
+            channel->send(run(job));
+        });
+    }
+
+    string ConversionServer::run(const ServerJob &job) {
+        AutosvgCLI inst = settings;
+        inst.inputFileName = job.input;
+        Profiler profiler;
+        inst.options.profiler = &profiler;
+
+        const auto start = chrono::steady_clock::now();
+        string failure;
+        try {
+            inst.outputFileName = job.output.empty() ? outputFileNameFor(job.input) : job.output;
+            inst.convertToFile(inst.outputFileName, job.colors, job.sharpness);
+        } catch (const exception &e) {
+            failure = e.what();
+        }
+        const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        metrics.recordJob(failure.empty(), seconds, profiler);
+
+        if (!failure.empty()) {
+            return errorResponse(job.id, failure);
+        }
+        ostringstream response;
+        response << "{\"id\": " << jsonString(job.id) << ", \"status\": \"ok\", \"output\": "
+                 << jsonString(inst.outputFileName) << ", \"seconds\": " << seconds << "}";
+        return response.str();
+    }
+
+    string ConversionServer::outputFileNameFor(const string &input) {
+        lock_guard<std::mutex> lock(outputLock);
+        for (unsigned int copy = 0;; copy++) {
+            // Without the extension, with it, then numbered copies from 2.
+            const auto name = BatchConverter::outputFileNameFor(input, outputDirectory, copy > 0, max(copy, 1u));
+            auto claimed = outputInputs.find(name);
+            if (claimed == outputInputs.end()) {
+                outputInputs[name] = input;
+                return name;
+            }
+            if (claimed->second == input) {
+                return name;
+            }
+        }
+    }
+
+    void ConversionServer::serveStream(istream &input, ostream &output) {
+        auto channel = make_shared<ResponseChannel>(output);
+        string line;
+        while (getline(input, line)) {
+            submit(line, channel);
+        }
+        pool.wait();
+    }
+
+    void ConversionServer::serveConnection(int connection) {
+        auto channel = make_shared<ResponseChannel>(connection);
+        string pending;
+        char buffer[4096];
+        for (;;) {
+            const auto received = read(connection, buffer, sizeof(buffer));
+            if (received <= 0) {
+                break;
+            }
+            pending.append(buffer, size_t(received));
+            size_t begin = 0;
+            for (size_t end; (end = pending.find('\n', begin)) != string::npos; begin = end + 1) {
+                // Blocks while the queue is full, the client's writes then block too.
+                submit(pending.substr(begin, end - begin), channel);
+            }
+            pending.erase(0, begin);
+            if (pending.size() > SERVER_MAX_LINE_BYTES) {
+                // Without a newline there is no telling where the next request starts.
+                channel->send(errorResponse("", "Request line longer than " + to_string(SERVER_MAX_LINE_BYTES) +
+                                                " bytes"));
+                return;
+            }
+        }
+        submit(pending, channel);
+    }
+
+    void ConversionServer::serveSocket(const string &path) {
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw invalid_argument("Socket path is too long: " + path);
+        }
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+        struct stat info;
+        if (stat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+            unlink(path.c_str());
+        }
+        const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0 || ::bind(listener, (sockaddr *) &address, sizeof(address)) != 0 ||
+            listen(listener, SOMAXCONN) != 0) {
+            throw runtime_error("Unable to listen on " + path + ": " + strerror(errno));
+        }
+
+        for (;;) {
+            {
+                unique_lock<std::mutex> lock(connectionLock);
+                connectionClosed.wait(lock, [this]() { return connections < SERVER_MAX_CONNECTIONS; });
+            }
+            const int connection = accept(listener, nullptr, nullptr);
+            if (connection < 0) {
+                const int error = errno;
+                if (acceptCanRetry(error)) {
+                    continue;
+                }
+                close(listener);
+                throw runtime_error("Unable to accept on " + path + ": " + strerror(error));
+            }
+            {
+                lock_guard<std::mutex> lock(connectionLock);
+                connections++;
+            }
+            thread([this, connection]() {
+                serveConnection(connection);
+                {
+                    lock_guard<std::mutex> lock(connectionLock);
+                    connections--;
+                }
+                connectionClosed.notify_one();
+            }).detach();
+        }
+    }
+
+    void ConversionServer::watch(const string &directory) {
+        struct FileState {
+            off_t size;
+            time_t modified;
+            bool submitted;
+        };
+        map<string, FileState> files;
+        auto channel = make_shared<ResponseChannel>(cout);
+
+        for (;;) {
+            map<string, FileState> listed;
+            for (const auto &path : BatchConverter::resolveInputs(directory)) {
+                struct stat info;
+                if (stat(path.c_str(), &info) != 0) {
+                    continue;
+                }
+                FileState state = {info.st_size, info.st_mtime, false};
+                auto known = files.find(path);
+                if (known != files.end() && known->second.size == state.size &&
+                    known->second.modified == state.modified) {
+                    // Unchanged since the last listing, so no longer being written.
+                    state.submitted = known->second.submitted;
+                    if (!state.submitted) {
+                        ServerJob job;
+                        job.input = path;
+                        job.colors = colors;
+                        job.sharpness = sharpness;
+                        submit(job, channel);
+                        state.submitted = true;
+                    }
+                }
+                listed[path] = state;
+            }
+            files.swap(listed);
+            this_thread::sleep_for(chrono::milliseconds(WATCH_INTERVAL_MS));
+        }
+    }
+
+    void ConversionServer::serveMetrics(int port) {
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(uint16_t(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        const int listener = socket(AF_INET, SOCK_STREAM, 0);
+        const int reuse = 1;
+        if (listener < 0 || setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+            ::bind(listener, (sockaddr *) &address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+            throw runtime_error("Unable to serve metrics on port " + to_string(port) + ": " + strerror(errno));
+        }
+
+        thread([this, listener]() {
+            for (;;) {
+                const int connection = accept(listener, nullptr, nullptr);
+                if (connection < 0) {
+                    const int error = errno;
+                    if (acceptCanRetry(error)) {
+                        continue;
+                    }
+                    // Conversions go on without metrics.
+                    cerr << "Metrics stopped, unable to accept: " << strerror(error) << endl;
+                    close(listener);
+                    return;
+                }
+                // A client that never sends its request or never reads must not stall later scrapes.
+                struct timeval timeout;
+                timeout.tv_sec = METRICS_TIMEOUT_MS / 1000;
+                timeout.tv_usec = (METRICS_TIMEOUT_MS % 1000) * 1000;
+                setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                // Every request gets the metrics, only the request line is read.
+                char request[1024];
+                if (read(connection, request, sizeof(request)) > 0) {
+                    ostringstream body;
+                    writeMetrics(body);
+                    const string content = body.str();
+                    const string response = "HTTP/1.0 200 OK\r\n"
+                                            "Content-Type: text/plain; version=0.0.4\r\n"
+                                            "Content-Length: " + to_string(content.size()) + "\r\n"
+                                            "Connection: close\r\n\r\n" + content;
+                    for (size_t sent = 0; sent < response.size();) {
+                        const auto written = write(connection, response.data() + sent, response.size() - sent);
+                        if (written <= 0) {
+                            break;
+                        }
+                        sent += size_t(written);
+                    }
+                }
+                close(connection);
+            }
+        }).detach();
+    }
+
+    void ConversionServer::writeMetrics(ostream &stream) const {
+        metrics.writePrometheus(stream, pool.queued(), pool.active(), queueSize);
+    }
+}
@@ -0,0 +1,133 @@
+#ifndef AUTOSVG_CLI_CONVERSIONSERVER_HPP
+#define AUTOSVG_CLI_CONVERSIONSERVER_HPP
+
+#include <condition_variable>
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utils/WorkerPool.hpp>
+#include <AutosvgCLI.hpp>
+#include "ServerMetrics.hpp"
+
+// Jobs accepted ahead of the workers before readers block.
+#define SERVER_QUEUE_SIZE 64
+// How often a watched inbox is listed.
+#define WATCH_INTERVAL_MS 500
+// Clients served at once, further ones wait in the listen backlog.
+#define SERVER_MAX_CONNECTIONS 64
+// Pause after accept() ran out of descriptors or memory.
+#define ACCEPT_RETRY_MS 100
+// Longest request line, a client sending more without a newline is dropped.
+#define SERVER_MAX_LINE_BYTES 65536
+// How long a metrics scrape may take to send its request or read the answer.
+#define METRICS_TIMEOUT_MS 2000
+
+namespace pi {
+
+    struct ServerJob {
+        std::string id;
+        std::string input;
+        std::string output;
+        int colors = K_COLORS;
+        int sharpness = SHARPNESS;
+    };
+
+    class ResponseChannel;
+
+    /**
+     * Long running conversion service, so a request does not pay for starting
+     * a process, loading OpenCV or growing fresh scratch buffers.
+     *
+     * Jobs arrive as JSON lines, `{"id": "...", "input": "in.png", "output":
+     * "out.svg", "colors": 3, "smoothness": 5}` where only `input` is required
+     * and `colors` may be "auto" (a bare path line works too), over a Unix
+     * domain socket, on stdin or as files dropped into a watched directory.
+     * Each is answered with one JSON
+     * line, `{"id": "...", "status": "ok", "output": "...", "seconds": 0.1}`
+     * or `{"id": "...", "status": "error", "error": "..."}`, in completion
+     * order on the channel it came from.
+     *
+     * A fixed set of workers converts with the settings' shared ContextPool.
+     * The queue in front of them is bounded, once it is full readers stop
+     * reading, so clients feel backpressure through their socket or pipe
+     * instead of the server buffering without limit.
+     */
+    class ConversionServer {
+    public:
+        /**
+         * Defaults of every job; `outputDirectory` receives the svg of jobs
+         * without an output.
+         */
+        AutosvgCLI settings;
+        std::string outputDirectory = ".";
+        int colors = K_COLORS;
+        int sharpness = SHARPNESS;
+
+        ConversionServer(unsigned int jobs, size_t queueSize = SERVER_QUEUE_SIZE);
+
+        /**
+         * Accepts connections on a Unix domain socket at `path`, replacing a
+         * stale one, up to SERVER_MAX_CONNECTIONS at a time. Only returns by
+         * throwing, when accepting fails for good.
+         */
+        void serveSocket(const std::string &path);
+
+        /**
+         * Serves the jobs read from `input` until it ends, answering on
+         * `output`, then waits for them to finish.
+         */
+        void serveStream(std::istream &input, std::ostream &output);
+
+        /**
+         * Converts every image that appears in `directory` once its size has
+         * stopped changing, again when it is replaced. Answers are logged to
+         * stdout. Never returns.
+         */
+        void watch(const std::string &directory);
+
+        /**
+         * Answers http requests on localhost `port` with the metrics, from a
+         * background thread.
+         */
+        void serveMetrics(int port);
+
+        void writeMetrics(std::ostream &stream) const;
+
+    private:
+        ServerMetrics metrics;
+        size_t queueSize;
+        // The input each default output was claimed by, see outputFileNameFor.
+        std::mutex outputLock;
+        std::map<std::string, std::string> outputInputs;
+        std::mutex connectionLock;
+        std::condition_variable connectionClosed;
+        unsigned int connections = 0;
+        // Last, so that the workers are joined before what they use is gone.
+        WorkerPool pool;
+
+        /**
+         * Parses one request line and queues it, blocking while the queue is
+         * full. Malformed lines are answered right away.
+         */
+        void submit(const std::string &line, const std::shared_ptr<ResponseChannel> &channel);
+
+        void submit(const ServerJob &job, const std::shared_ptr<ResponseChannel> &channel);
+
+        std::string run(const ServerJob &job);
+
+        /**
+         * The svg of a job without an output. An input keeps the name it
+         * first got, e.g. when a watched file is replaced. A name already
+         * claimed by another input falls back to keeping the extension, then
+         * to numbered copies of that, e.g. `x.png-2.svg`.
+         */
+        std::string outputFileNameFor(const std::string &input);
+
+        void serveConnection(int connection);
+    };
+}
+
+#endif //AUTOSVG_CLI_CONVERSIONSERVER_HPP
@@ -0,0 +1,112 @@
+#include <fstream>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "ServerMetrics.hpp"
+
+using namespace std;
+
+namespace pi {
+    // Upper bounds in seconds, from a cached fit to a large batch image.
+    static const double LATENCY_BUCKETS[] = {
+            0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+    };
+    static const size_t LATENCY_BUCKET_COUNT = sizeof(LATENCY_BUCKETS) / sizeof(LATENCY_BUCKETS[0]);
+
+    static void observe(LatencyHistogram &histogram, double seconds) {
+        if (histogram.buckets.empty()) {
+            histogram.buckets.assign(LATENCY_BUCKET_COUNT, 0);
+        }
+        for (size_t i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+            if (seconds <= LATENCY_BUCKETS[i]) {
+                histogram.buckets[i]++;
+            }
+        }
+        histogram.count++;
+        histogram.sum += seconds;
+    }
+
+    static void writeHistogram(ostream &stream, const string &name, const string &labels,
+                               const LatencyHistogram &histogram) {
+        const string separator = labels.empty() ? "" : ",";
+        for (size_t i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+            const auto count = histogram.buckets.empty() ? 0 : histogram.buckets[i];
+            stream << name << "_bucket{" << labels << separator << "le=\"" << LATENCY_BUCKETS[i] << "\"} "
+                   << count << "\n";
+        }
+        stream << name << "_bucket{" << labels << separator << "le=\"+Inf\"} " << histogram.count << "\n";
+        const string braces = labels.empty() ? "" : "{" + labels + "}";
+        stream << name << "_sum" << braces << " " << histogram.sum << "\n";
+        stream << name << "_count" << braces << " " << histogram.count << "\n";
+    }
+
+    /**
+     * Current resident set size, 0 where /proc is not available.
+     */
+    static size_t residentBytes() {
+        ifstream statm("/proc/self/statm");
+        size_t pages = 0, resident = 0;
+        if (statm >> pages >> resident) {
+            return resident * size_t(sysconf(_SC_PAGESIZE));
+        }
+        return 0;
+    }
+
+    static size_t peakResidentBytes() {
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+#ifdef __APPLE__
+        return size_t(usage.ru_maxrss);
+#else
+        return size_t(usage.ru_maxrss) * 1024;
+#endif
+    }
+
+    void ServerMetrics::recordJob(bool succeeded, double seconds, const Profiler &profiler) {
+        const auto recorded = profiler.stages();
+        lock_guard<std::mutex> lock(mutex);
+        (succeeded ? this->succeeded : failed)++;
+        observe(jobs, seconds);
+        for (const auto &stage : recorded) {
+            observe(stages[stage.name], stage.wall);
+        }
+    }
+
+    void ServerMetrics::writePrometheus(ostream &stream, size_t queued, size_t running, size_t capacity) const {
+        lock_guard<std::mutex> lock(mutex);
+        stream << "# HELP autosvg_jobs_total Finished conversion jobs.\n"
+               << "# TYPE autosvg_jobs_total counter\n"
+               << "autosvg_jobs_total{status=\"ok\"} " << succeeded << "\n"
+               << "autosvg_jobs_total{status=\"error\"} " << failed << "\n";
+
+        stream << "# HELP autosvg_queue_depth Jobs waiting for a worker.\n"
+               << "# TYPE autosvg_queue_depth gauge\n"
+               << "autosvg_queue_depth " << queued << "\n"
+               << "# HELP autosvg_queue_capacity Jobs the queue holds before submitters block.\n"
+               << "# TYPE autosvg_queue_capacity gauge\n"
+               << "autosvg_queue_capacity " << capacity << "\n"
+               << "# HELP autosvg_jobs_running Jobs being converted.\n"
+               << "# TYPE autosvg_jobs_running gauge\n"
+               << "autosvg_jobs_running " << running << "\n";
+
+        stream << "# HELP autosvg_job_seconds Wall time of a job from dequeue to the written svg.\n"
+               << "# TYPE autosvg_job_seconds histogram\n";
+        writeHistogram(stream, "autosvg_job_seconds", "", jobs);
+
+        stream << "# HELP autosvg_stage_seconds Wall time of a pipeline stage.\n"
+               << "# TYPE autosvg_stage_seconds histogram\n";
+        for (const auto &stage : stages) {
+            writeHistogram(stream, "autosvg_stage_seconds", "stage=\"" + stage.first + "\"", stage.second);
+        }
+
+        stream << "# HELP process_resident_memory_bytes Resident memory size in bytes.\n"
+               << "# TYPE process_resident_memory_bytes gauge\n"
+               << "process_resident_memory_bytes " << residentBytes() << "\n"
+               << "# HELP autosvg_peak_resident_memory_bytes Largest resident memory size in bytes.\n"
+               << "# TYPE autosvg_peak_resident_memory_bytes gauge\n"
+               << "autosvg_peak_resident_memory_bytes " << peakResidentBytes() << "\n";
+    }
+}
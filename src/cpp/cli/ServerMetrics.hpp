@@ -0,0 +1,48 @@
+#ifndef AUTOSVG_CLI_SERVERMETRICS_HPP
+#define AUTOSVG_CLI_SERVERMETRICS_HPP
+
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <utils/Profiler.hpp>
+
+namespace pi {
+
+    /**
+     * Cumulative latency histogram with the bucket bounds of ServerMetrics.
+     */
+    struct LatencyHistogram {
+        std::vector<unsigned long> buckets;
+        unsigned long count = 0;
+        double sum = 0;
+    };
+
+    /**
+     * Counters of a ConversionServer, written in the Prometheus text
+     * exposition format. Recording takes a lock, one per finished job.
+     */
+    class ServerMetrics {
+    public:
+        /**
+         * Counts a finished job and adds its total and per stage wall times
+         * from `profiler` to the latency histograms.
+         */
+        void recordJob(bool succeeded, double seconds, const Profiler &profiler);
+
+        /**
+         * Writes every counter, with the queue gauges sampled by the caller.
+         */
+        void writePrometheus(std::ostream &stream, size_t queued, size_t running, size_t capacity) const;
+
+    private:
+        mutable std::mutex mutex;
+        unsigned long succeeded = 0;
+        unsigned long failed = 0;
+        LatencyHistogram jobs;
+        std::map<std::string, LatencyHistogram> stages;
+    };
+}
+
+#endif //AUTOSVG_CLI_SERVERMETRICS_HPP
@@ -0,0 +1,410 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "StageCache.hpp"
+
+using namespace std;
+
+namespace pi {
+    static const char ENTRY_MAGIC[4] = {'A', 'S', 'V', 'C'};
+    static const char *ENTRY_EXTENSION = ".stages";
+    static const char *LOCK_FILE_NAME = ".lock";
+    static const char *TEMPORARY_EXTENSION = ".tmp";
+
+    /**
+     * 64 bit FNV-1a, continuing from `hash`.
+     */
+    static uint64_t fnv1a(const void *data, size_t size, uint64_t hash = 14695981039346656037ull) {
+        const auto *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static string hex(uint64_t value) {
+        char digits[17];
+        snprintf(digits, sizeof(digits), "%016llx", (unsigned long long) value);
+        return digits;
+    }
+
+    /**
+     * Appends integers as LEB128 varints, signed ones zigzag encoded, so the
+     * small values and unit steps that make up most of an entry take a byte.
+     */
+    class EntryWriter {
+    public:
+        vector<char> bytes;
+
+        void unsignedValue(uint64_t value) {
+            while (value >= 0x80) {
+                bytes.push_back(char((value & 0x7f) | 0x80));
+                value >>= 7;
+            }
+            bytes.push_back(char(value));
+        }
+
+        void signedValue(int64_t value) {
+            unsignedValue((uint64_t(value) << 1) ^ uint64_t(value >> 63));
+        }
+
+        void raw(const void *data, size_t size) {
+            const auto *begin = static_cast<const char *>(data);
+            bytes.insert(bytes.end(), begin, begin + size);
+        }
+
+        void pixels(const vector<Pixel> &colors) {
+            unsignedValue(colors.size());
+            raw(colors.data(), colors.size() * sizeof(Pixel));
+        }
+    };
+
+    /**
+     * Reads what EntryWriter wrote, throwing on truncated input.
+     */
+    class EntryReader {
+    public:
+        EntryReader(const char *data, size_t size) : position(data), end(data + size) {}
+
+        uint64_t unsignedValue() {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (position == end) {
+                    throw runtime_error("Truncated stage cache entry");
+                }
+                const auto byte = (unsigned char) *position++;
+                value |= uint64_t(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    return value;
+                }
+            }
+            throw runtime_error("Invalid stage cache entry");
+        }
+
+        int64_t signedValue() {
+            const uint64_t value = unsignedValue();
+            return int64_t(value >> 1) ^ -int64_t(value & 1);
+        }
+
+        /**
+         * A length prefix of elements taking at least `elementSize` bytes each.
+         */
+        size_t count(size_t elementSize) {
+            const uint64_t value = unsignedValue();
+            if (value > size_t(end - position) / elementSize) {
+                throw runtime_error("Invalid stage cache entry");
+            }
+            return size_t(value);
+        }
+
+        void raw(void *data, size_t size) {
+            if (size > size_t(end - position)) {
+                throw runtime_error("Truncated stage cache entry");
+            }
+            memcpy(data, position, size);
+            position += size;
+        }
+
+        void pixels(vector<Pixel> &colors) {
+            colors.resize(count(sizeof(Pixel)));
+            raw(colors.data(), colors.size() * sizeof(Pixel));
+        }
+
+        bool finished() const {
+            return position == end;
+        }
+
+    private:
+        const char *position;
+        const char *end;
+    };
+
+    /**
+     * Label maps are stored as runs per row, quantized images have few long ones.
+     */
+    static void writeLabels(EntryWriter &writer, const cv::Mat &labels) {
+        writer.unsignedValue(labels.rows);
+        writer.unsignedValue(labels.cols);
+        for (int row = 0; row < labels.rows; row++) {
+            const auto *label = labels.ptr<uchar>(row);
+            for (int col = 0; col < labels.cols;) {
+                int run = col + 1;
+                while (run < labels.cols && label[run] == label[col]) {
+                    run++;
+                }
+                writer.bytes.push_back(char(label[col]));
+                writer.unsignedValue(run - col);
+                col = run;
+            }
+        }
+    }
+
+    static void readLabels(EntryReader &reader, cv::Mat &labels) {
+        const auto rows = reader.unsignedValue();
+        const auto cols = reader.unsignedValue();
+        if (rows > uint64_t(INT_MAX) || cols > uint64_t(INT_MAX) || rows * cols > uint64_t(INT_MAX)) {
+            throw runtime_error("Invalid stage cache entry");
+        }
+        labels.create(int(rows), int(cols), CV_8UC1);
+        for (int row = 0; row < labels.rows; row++) {
+            auto *label = labels.ptr<uchar>(row);
+            for (int col = 0; col < labels.cols;) {
+                uchar value;
+                reader.raw(&value, 1);
+                const auto run = reader.unsignedValue();
+                if (run == 0 || run > uint64_t(labels.cols - col)) {
+                    throw runtime_error("Invalid stage cache entry");
+                }
+                memset(label + col, value, run);
+                col += int(run);
+            }
+        }
+    }
+
+    /**
+     * Contours are stored as their first point and the steps between the
+     * following ones, traced boundaries mostly move by a single pixel.
+     */
+    static void writeContours(EntryWriter &writer, const vector<Contour> &contours) {
+        writer.unsignedValue(contours.size());
+        for (const auto &contour : contours) {
+            writer.unsignedValue(contour.size());
+            cv::Point previous(0, 0);
+            for (const auto &point : contour) {
+                writer.signedValue(point.x - previous.x);
+                writer.signedValue(point.y - previous.y);
+                previous = point;
+            }
+        }
+    }
+
+    static void readContours(EntryReader &reader, vector<Contour> &contours) {
+        contours.resize(reader.count(1));
+        for (auto &contour : contours) {
+            contour.resize(reader.count(2));
+            cv::Point previous(0, 0);
+            for (auto &point : contour) {
+                point.x = previous.x + int(reader.signedValue());
+                point.y = previous.y + int(reader.signedValue());
+                previous = point;
+            }
+        }
+    }
+
+    static bool hasExtension(const string &name, const char *extension) {
+        const size_t length = strlen(extension);
+        return name.size() > length && name.compare(name.size() - length, length, extension) == 0;
+    }
+
+    StageCache::StageCache(const string &directory, size_t maxBytes) : directory(directory), maxBytes(maxBytes) {
+        if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+            throw runtime_error("Unable to create cache directory " + directory);
+        }
+        lock_guard<std::mutex> lock(mutex);
+        trimLocked();
+    }
+
+    string StageCache::key(const vector<char> &content, const ConversionOptions &options) {
+        // Only what decode, segmentation and tracing depend on, fitting and
+        // serialization settings reuse the same entry.
+        const int32_t parameters[] = {
+                STAGE_CACHE_VERSION, options.colors, options.width, options.quantizer, options.tracer
+        };
+        uint64_t hash = fnv1a(content.data(), content.size());
+        hash = fnv1a(parameters, sizeof(parameters), hash);
+        hash = fnv1a(options.palette.data(), options.palette.size() * sizeof(cv::Vec3b), hash);
+        // The length makes a collision of the 64 bit hash alone harmless.
+        return hex(hash) + "-" + hex(content.size());
+    }
+
+    bool StageCache::caches(const ConversionOptions &options) {
+        return options.tileSize <= 0 && !options.pyramid;
+    }
+
+    string StageCache::pathFor(const string &key) const {
+        return directory + "/" + key + ENTRY_EXTENSION;
+    }
+
+    bool StageCache::load(const string &key, ConversionContext &context, cv::Size &original, cv::Size &traced) {
+        const string path = pathFor(key);
+        ifstream file(path, ios::binary);
+        if (!file) {
+            return false;
+        }
+        const vector<char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        const size_t header = sizeof(ENTRY_MAGIC) + sizeof(uint64_t);
+        if (bytes.size() < header || memcmp(bytes.data(), ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) != 0) {
+            return false;
+        }
+        uint64_t checksum;
+        memcpy(&checksum, bytes.data() + sizeof(ENTRY_MAGIC), sizeof(checksum));
+        if (fnv1a(bytes.data() + header, bytes.size() - header) != checksum) {
+            return false;
+        }
+
+        try {
+            EntryReader reader(bytes.data() + header, bytes.size() - header);
+            if (reader.unsignedValue() != STAGE_CACHE_VERSION) {
+                return false;
+            }
+            original.width = int(reader.unsignedValue());
+            original.height = int(reader.unsignedValue());
+            traced.width = int(reader.unsignedValue());
+            traced.height = int(reader.unsignedValue());
+
+            SegmentedEdgeResult &segments = context.segments;
+            reader.pixels(segments.colors);
+            readLabels(reader, segments.labels);
+            readContours(reader, segments.edges);
+            segments.edgeLabels.resize(reader.count(1));
+            for (auto &label : segments.edgeLabels) {
+                label = int(reader.unsignedValue());
+            }
+            reader.pixels(context.colors);
+            if (!reader.finished() || context.colors.size() != segments.edges.size()) {
+                return false;
+            }
+        } catch (const runtime_error &) {
+            return false;
+        }
+
+        // The modification time is the entry's last use, atime is often off.
+        utime(path.c_str(), nullptr);
+        return true;
+    }
+
+    void StageCache::store(const string &key, const ConversionContext &context, cv::Size original,
+                           cv::Size traced) {
+        const SegmentedEdgeResult &segments = context.segments;
+        EntryWriter writer;
+        writer.unsignedValue(STAGE_CACHE_VERSION);
+        writer.unsignedValue(original.width);
+        writer.unsignedValue(original.height);
+        writer.unsignedValue(traced.width);
+        writer.unsignedValue(traced.height);
+        writer.pixels(segments.colors);
+        writeLabels(writer, segments.labels);
+        writeContours(writer, segments.edges);
+        writer.unsignedValue(segments.edgeLabels.size());
+        for (auto label : segments.edgeLabels) {
+            writer.unsignedValue(uint64_t(label));
+        }
+        writer.pixels(context.colors);
+
+        const uint64_t checksum = fnv1a(writer.bytes.data(), writer.bytes.size());
+
+        // Unique per process and thread, renamed over any entry written
+        // concurrently for the same key, which holds the same stages.
+        static atomic<unsigned long> written(0);
+        ostringstream temporary;
+        temporary << directory << "/." << key << "." << getpid() << "." << written++ << TEMPORARY_EXTENSION;
+        {
+            ofstream file(temporary.str(), ios::binary);
+            file.write(ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+            file.write(reinterpret_cast<const char *>(&checksum), sizeof(checksum));
+            file.write(writer.bytes.data(), writer.bytes.size());
+            if (!file) {
+                file.close();
+                remove(temporary.str().c_str());
+                return;
+            }
+        }
+        if (rename(temporary.str().c_str(), pathFor(key).c_str()) != 0) {
+            remove(temporary.str().c_str());
+            return;
+        }
+
+        lock_guard<std::mutex> lock(mutex);
+        knownBytes += sizeof(ENTRY_MAGIC) + sizeof(checksum) + writer.bytes.size();
+        if (knownBytes > maxBytes) {
+            trimLocked();
+        }
+    }
+
+    void StageCache::trim() {
+        lock_guard<std::mutex> lock(mutex);
+        trimLocked();
+    }
+
+    void StageCache::trimLocked() {
+        const string lockPath = directory + "/" + LOCK_FILE_NAME;
+        const int lockFile = open(lockPath.c_str(), O_RDWR | O_CREAT, 0644);
+        if (lockFile < 0) {
+            return;
+        }
+        // Another process trimming right now leaves nothing to do.
+        if (flock(lockFile, LOCK_EX | LOCK_NB) != 0) {
+            close(lockFile);
+            return;
+        }
+
+        struct Entry {
+            string path;
+            size_t bytes;
+            time_t used;
+        };
+        vector<Entry> entries;
+        size_t total = 0;
+        const time_t staleBefore = time(nullptr) - STAGE_CACHE_TEMPORARY_AGE;
+        if (DIR *dir = opendir(directory.c_str())) {
+            while (struct dirent *file = readdir(dir)) {
+                const string name = file->d_name;
+                const bool temporary = name[0] == '.' && hasExtension(name, TEMPORARY_EXTENSION);
+                if (!temporary && (name[0] == '.' || !hasExtension(name, ENTRY_EXTENSION))) {
+                    continue;
+                }
+                struct stat info;
+                const string path = directory + "/" + name;
+                if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+                    continue;
+                }
+                if (temporary) {
+                    // Writers rename theirs within moments, an old one will never be.
+                    if (info.st_mtime < staleBefore) {
+                        unlink(path.c_str());
+                    }
+                    continue;
+                }
+                entries.push_back({path, size_t(info.st_size), info.st_mtime});
+                total += size_t(info.st_size);
+            }
+            closedir(dir);
+        }
+
+        if (total > maxBytes) {
+            sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+                return a.used < b.used;
+            });
+            const auto target = size_t(maxBytes * STAGE_CACHE_LOW_WATERMARK);
+            // Readers holding an entry open keep reading it after the unlink.
+            for (const auto &entry : entries) {
+                if (total <= target) {
+                    break;
+                }
+                if (unlink(entry.path.c_str()) == 0 || errno == ENOENT) {
+                    total -= entry.bytes;
+                }
+            }
+        }
+        knownBytes = total;
+
+        flock(lockFile, LOCK_UN);
+        close(lockFile);
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef AUTOSVG_CLI_STAGECACHE_HPP
+#define AUTOSVG_CLI_STAGECACHE_HPP
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+#include <core/AutosvgConverter.hpp>
+#include <core/ConversionContext.hpp>
+
+// Default size limit in MB.
+#define STAGE_CACHE_SIZE 1024
+// Trimming removes entries until the cache is this full again, so that it
+// does not run on every store once the limit is reached.
+#define STAGE_CACHE_LOW_WATERMARK 0.9
+// Bumped whenever the entry format or the stages it caches change.
+#define STAGE_CACHE_VERSION 1
+// Temporary files older than this many seconds were left by a writer that
+// died, trimming removes them.
+#define STAGE_CACHE_TEMPORARY_AGE 3600
+
+namespace pi {
+
+    /**
+     * On-disk cache of segmentations, shared by any number of threads and
+     * processes.
+     *
+     * An entry holds the palette, label map, traced contours and region colors
+     * of one input file for one set of stage parameters, named after a hash of
+     * the file's content and those parameters. Converting the same file again
+     * then only fits and writes, it is not even decoded.
+     *
+     * Entries are written to a temporary file and renamed into place, so
+     * readers never see a partial one, and carry a checksum, so a damaged one
+     * is a miss. Reading an entry touches it; once the directory grows beyond
+     * `maxBytes` the least recently used entries are removed under a lock file,
+     * by whichever process noticed first. Trimming, which also runs when a
+     * cache is opened, removes stale temporary files as well.
+     */
+    class StageCache {
+    public:
+        StageCache(const std::string &directory, size_t maxBytes);
+
+        /**
+         * Name of the entry for `content`, the bytes of an input file,
+         * converted with the stage parameters in `options`.
+         */
+        static std::string key(const std::vector<char> &content, const ConversionOptions &options);
+
+        /**
+         * Whether `options` run the stages the cache stores, tiled and pyramid
+         * conversions do not.
+         */
+        static bool caches(const ConversionOptions &options);
+
+        /**
+         * Loads an entry into `context.segments` and `context.colors`.
+         * Returns false when there is no valid entry.
+         */
+        bool load(const std::string &key, ConversionContext &context, cv::Size &original, cv::Size &traced);
+
+        /**
+         * Stores what AutosvgConverter::segment() left in `context`. Failing to
+         * write is not an error, the entry is just missing.
+         */
+        void store(const std::string &key, const ConversionContext &context, cv::Size original, cv::Size traced);
+
+        /**
+         * Removes the least recently used entries while the directory holds
+         * more than `maxBytes`.
+         */
+        void trim();
+
+    private:
+        std::string directory;
+        size_t maxBytes;
+        std::mutex mutex;
+        /**
+         * Size of the directory at the last trim plus what this process
+         * stored since, other processes' entries are seen by the next trim.
+         */
+        size_t knownBytes = 0;
+
+        std::string pathFor(const std::string &key) const;
+
+        void trimLocked();
+    };
+}
+
+#endif //AUTOSVG_CLI_STAGECACHE_HPP
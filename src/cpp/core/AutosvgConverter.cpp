@@ -0,0 +1,215 @@
+#include <stdexcept>
+
+#include "AutosvgConverter.hpp"
+#include "Operations.hpp"
+#include "BoundaryTracer.hpp"
+#include "TiledConversion.hpp"
+#include "PyramidConversion.hpp"
+#include <utils/CurveUtils.hpp>
+
+using namespace std;
+
+namespace pi {
+    static inline int channelsOf(PixelFormat format) {
+        return format == RGBA_FORMAT || format == BGRA_FORMAT ? 4 : 3;
+    }
+
+    static vector<SVGParam> svgParams(cv::Size original, cv::Size traced) {
+        // Paths use the coordinates of the traced image, the viewBox maps
+        // them back onto the size of the original one.
+        return {
+                {"width",   to_string(original.width)},
+                {"height",  to_string(original.height)},
+                {"viewBox", "0 0 " + to_string(traced.width) + " " + to_string(traced.height)},
+                {"xmlns",   "http://www.w3.org/2000/svg"}
+        };
+    }
+
+    AutosvgConverter::AutosvgConverter(const ConversionOptions &options, shared_ptr<ContextPool> contexts)
+            : options(options), contexts(contexts ? std::move(contexts) : make_shared<ContextPool>()) {}
+
+    void AutosvgConverter::convert(const cv::Mat &image, PixelFormat format, SvgSink &sink, cv::Mat *edgePreview,
+                                   ConversionContext *context) const {
+        if (image.empty() || image.depth() != CV_8U || image.channels() != channelsOf(format)) {
+            throw invalid_argument("Expected a non empty 8 bit image with " + to_string(channelsOf(format)) +
+                                   " channels");
+        }
+        if (context) {
+            runPipeline(image, format, sink, edgePreview, *context);
+            return;
+        }
+        ContextLease lease(*contexts);
+        runPipeline(image, format, sink, edgePreview, *lease.context);
+    }
+
+    void AutosvgConverter::runPipeline(const cv::Mat &image, PixelFormat format, SvgSink &sink,
+                                       cv::Mat *edgePreview, ConversionContext &context) const {
+        if (options.tileSize > 0 && edgePreview) {
+            throw invalid_argument("Tiled conversion has no edge preview");
+        }
+        if (options.pyramid && edgePreview) {
+            throw invalid_argument("Pyramid conversion has no edge preview");
+        }
+        const cv::Mat img = prepareImage(image, format, context);
+
+        vector<Curve> &curves = context.curves;
+        if (options.tileSize > 0) {
+            TiledConversion::convertToCurves(img, format, options, context);
+        } else if (options.pyramid) {
+            PyramidConversion::convertToCurves(img, options, context);
+        } else {
+            segment(img, edgePreview, context);
+            if (options.progressiveBatch > 0) {
+                writeSvgProgressively(context.segments.edges, options.sharpness, context.colors, curves,
+                                      image.size(), img.size(), sink, context);
+                return;
+            }
+            fit(context);
+        }
+
+        writeSvg(curves, image.size(), img.size(), sink, context);
+    }
+
+    void AutosvgConverter::segment(const cv::Mat &image, cv::Mat *edgePreview, ConversionContext &context) const {
+        cv::Mat src = image;
+        Operations::findColorSegmentedEdge(&src, edgePreview, options.colors, options.quantizer, options.tracer,
+                                           options.profiler, context, &options.palette);
+        ProfileScope color(options.profiler, "color");
+        const SegmentedEdgeResult &segments = context.segments;
+        if (options.palette.empty()) {
+            Operations::findContoursAvgColor(image, segments.edges, context.colors, context.regionLabels);
+        } else {
+            // A fixed palette is the output's colors, so regions keep their entry instead of an average.
+            context.colors.clear();
+            for (size_t i = 0; i < segments.edges.size(); i++) {
+                // Contour tracing paints a hole ring with the color around it, like the averaging does.
+                const auto label = options.tracer == CONTOUR_TRACING
+                                   ? segments.edgeLabels[i]
+                                   : BoundaryTracer::insideLabel(segments.labels, segments.edges[i],
+                                                                 segments.edgeLabels[i]);
+                const cv::Vec3b &entry = options.palette[label];
+                context.colors.emplace_back(entry[0], entry[1], entry[2]);
+            }
+        }
+        color.items(segments.edges.size());
+    }
+
+    void AutosvgConverter::fit(ConversionContext &context) const {
+        ProfileScope fit(options.profiler, "fit");
+        CurveUtils::convertContoursToBezierCurves(context.segments.edges, options.sharpness, context.colors,
+                                                  options.fitting, context.curves, context.fitters);
+        size_t segments = 0;
+        for (const auto &curve : context.curves) {
+            segments += curve.segments.size();
+        }
+        fit.items(segments);
+    }
+
+    cv::Mat AutosvgConverter::prepareImage(const cv::Mat &image, PixelFormat format,
+                                           ConversionContext &context) const {
+        // Downscale first so that the color conversion touches fewer pixels.
+        // Both steps write into new buffers, the caller's pixels are never
+        // modified. Smaller images are not upscaled, that adds no detail.
+        // RGBA already has the channel order of RGB, the stages read its first
+        // three channels in place instead of copying the image without alpha.
+        cv::Mat img = image;
+        ProfileScope resizing(options.profiler, "resize");
+        if (options.width > 0 && img.cols > options.width && !options.pyramid && options.tileSize <= 0) {
+            auto ratio = img.rows / (img.cols * 1.0);
+            cv::resize(img, context.resized, cv::Size(options.width, max(1, int(options.width * ratio))), 0, 0);
+            img = context.resized;
+        }
+        // Tiles convert their own pixels, so large images are never copied whole.
+        if (format != RGB_FORMAT && format != RGBA_FORMAT && options.tileSize <= 0) {
+            static const int conversions[] = {-1, -1, cv::COLOR_BGR2RGB, cv::COLOR_BGRA2RGB};
+            cv::cvtColor(img, context.rgb, conversions[format]);
+            img = context.rgb;
+        }
+        resizing.items(img.total());
+        return img;
+    }
+
+    void AutosvgConverter::writeSvg(const vector<Curve> &curves, cv::Size original, cv::Size traced, SvgSink &sink,
+                                    ConversionContext &context) const {
+        const vector<SVGParam> params = svgParams(original, traced);
+        // Time spent in the sink is reported as the write stage.
+        ProfiledSink profiledSink(sink, options.profiler);
+        {
+            ProfileScope serialize(options.profiler, "serialize");
+            CurveUtils::writeSvgFromBezierCurves(curves, params, profiledSink, options.pathData,
+                                                 &context.svgBuffer);
+            serialize.exclude(profiledSink.stage());
+            serialize.items(curves.size());
+        }
+        profiledSink.finish();
+    }
+
+    void AutosvgConverter::writeSvgProgressively(const vector<Contour> &contours, int sharpness,
+                                                 const vector<Pixel> &colors, vector<Curve> &curves,
+                                                 cv::Size original, cv::Size traced, SvgSink &sink,
+                                                 ConversionContext &context) const {
+        vector<size_t> &order = context.paintOrder;
+        CurveUtils::paintOrder(contours, order);
+        curves.resize(contours.size());
+
+        // Fit and serialize alternate per batch; the time spent in the sink
+        // is part of the serialize stages here.
+        SvgWriter writer(sink, context.svgBuffer);
+        PathEncoder encoder(writer, options.pathData);
+        {
+            ProfileScope serialize(options.profiler, "serialize");
+            writer.begin(svgParams(original, traced));
+            writer.flush();
+            sink.flush();
+        }
+
+        size_t batch = max(options.progressiveBatch, size_t(1));
+        for (size_t begin = 0; begin < order.size(); begin += batch, batch *= 2) {
+            const size_t count = min(batch, order.size() - begin);
+            {
+                ProfileScope fit(options.profiler, "fit");
+                CurveUtils::convertContoursToBezierCurves(contours, order.data() + begin, count, sharpness, colors,
+                                                          options.fitting, curves, context.fitters);
+                fit.items(count);
+            }
+
+            ProfileScope serialize(options.profiler, "serialize");
+            for (size_t i = begin; i < begin + count; i++) {
+                const Curve &curve = curves[order[i]];
+                writer.beginPath();
+                encoder.encode(curve);
+                writer.endPath(curve.color);
+            }
+            // The last batch is flushed by end().
+            if (begin + count < order.size()) {
+                writer.flush();
+                sink.flush();
+            }
+            serialize.items(count);
+        }
+
+        ProfileScope serialize(options.profiler, "serialize");
+        writer.end();
+    }
+
+    void AutosvgConverter::convert(const unsigned char *pixels, int width, int height, size_t stride,
+                                   PixelFormat format, SvgSink &sink) const {
+        if (!pixels || width <= 0 || height <= 0) {
+            throw invalid_argument("Expected a non empty pixel buffer");
+        }
+        const int channels = channelsOf(format);
+        const cv::Mat image(height, width, CV_8UC(channels), const_cast<unsigned char *>(pixels),
+                            stride ? stride : cv::Mat::AUTO_STEP);
+        convert(image, format, sink);
+    }
+
+    string AutosvgConverter::convertToSvg(const cv::Mat &image, PixelFormat format) const {
+        BufferSink sink;
+        convert(image, format, sink);
+        return std::move(sink.buffer);
+    }
+
+    void AutosvgConverter::releaseScratch() const {
+        contexts->clear();
+    }
+}
@@ -0,0 +1,150 @@
+#ifndef AUTOSVG_WASM_AUTOSVGCONVERTER_HPP
+#define AUTOSVG_WASM_AUTOSVGCONVERTER_HPP
+
+#include <memory>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include <utils/Constants.hpp>
+#include <utils/PathEncoder.hpp>
+#include <utils/Profiler.hpp>
+#include <utils/SvgWriter.hpp>
+#include "ConversionContext.hpp"
+
+namespace pi {
+
+    enum PixelFormat {
+        RGB_FORMAT,
+        RGBA_FORMAT,
+        BGR_FORMAT,
+        BGRA_FORMAT
+    };
+
+    struct ConversionOptions {
+        int colors = K_COLORS;
+        int sharpness = SHARPNESS;
+        /**
+         * Wider images are downscaled to this width before tracing, 0 keeps
+         * their size. In pyramid mode it is the width of the coarse level.
+         */
+        int width = CONVERSION_WIDTH;
+        /**
+         * Segments at `width` and refines the boundaries at full resolution,
+         * see PyramidConversion.
+         */
+        bool pyramid = false;
+        /**
+         * Side of the square tiles large images are traced in at full
+         * resolution, 0 traces the whole image at once. See TiledConversion.
+         */
+        int tileSize = 0;
+        /**
+         * Bytes a tiled conversion may hold, 0 for no limit. It fails with
+         * std::runtime_error instead of growing past it.
+         */
+        size_t memoryBudget = 0;
+        /**
+         * Writes the svg while fitting, this many curves before the first
+         * flush of the sink, see writeSvgProgressively(). 0 writes it once
+         * every curve is fitted. Tiled and pyramid conversions ignore it.
+         */
+        size_t progressiveBatch = 0;
+        QuantizationEngine quantizer = QUANTIZATION_ENGINE;
+        /**
+         * Fixed RGB colors every pixel is mapped to, skipping the quantizer.
+         * `colors` and `quantizer` are ignored when it is not empty.
+         */
+        std::vector<cv::Vec3b> palette;
+        TracingEngine tracer = TRACING_ENGINE;
+        FittingMode fitting = FITTING_MODE;
+        PathDataOptions pathData;
+        Profiler *profiler = nullptr;
+    };
+
+    /**
+     * Converts in-memory images to svg.
+     *
+     * Each conversion leases a ConversionContext from the converter's pool and
+     * returns it afterwards, so one converter may be shared by any number of
+     * threads and repeated conversions reuse their buffers. Converters created
+     * with the same `contexts` share one pool.
+     */
+    class AutosvgConverter {
+    public:
+        ConversionOptions options;
+
+        explicit AutosvgConverter(const ConversionOptions &options = ConversionOptions(),
+                                  std::shared_ptr<ContextPool> contexts = nullptr);
+
+        /**
+         * Converts an 8 bit image with 3 or 4 channels in `format`. When
+         * `edgePreview` is given it receives the traced edges as an RGB image
+         * of the working size, except in tiled and pyramid mode. With a `context` its buffers
+         * are used instead of a pooled one.
+         */
+        void convert(const cv::Mat &image, PixelFormat format, SvgSink &sink, cv::Mat *edgePreview = nullptr,
+                     ConversionContext *context = nullptr) const;
+
+        /**
+         * Converts a pixel buffer without copying it first. `stride` is the row
+         * size in bytes, 0 for tightly packed rows.
+         */
+        void convert(const unsigned char *pixels, int width, int height, size_t stride, PixelFormat format,
+                     SvgSink &sink) const;
+
+        std::string convertToSvg(const cv::Mat &image, PixelFormat format) const;
+
+        /**
+         * Frees the buffers of every idle context.
+         */
+        void releaseScratch() const;
+
+        /**
+         * The image the pipeline traces: `image` downscaled to the working
+         * width, in buffers of `context`. BGR and BGRA are converted to RGB,
+         * RGB and RGBA are kept as they are and every stage reads the first
+         * three channels. May share the caller's pixels when neither step
+         * applies.
+         */
+        cv::Mat prepareImage(const cv::Mat &image, PixelFormat format, ConversionContext &context) const;
+
+        /**
+         * The stages of the resized pipeline up to the region colors, on an
+         * image from prepareImage(). Leaves the regions in `context.segments`
+         * and their colors in `context.colors`.
+         */
+        void segment(const cv::Mat &image, cv::Mat *edgePreview, ConversionContext &context) const;
+
+        /**
+         * Fits the regions segment() left in `context` into `context.curves`.
+         */
+        void fit(ConversionContext &context) const;
+
+        /**
+         * Writes `curves`, traced on an image of `traced` size, as an svg of
+         * the `original` size.
+         */
+        void writeSvg(const std::vector<Curve> &curves, cv::Size original, cv::Size traced, SvgSink &sink,
+                      ConversionContext &context) const;
+
+        /**
+         * Fits `contours` into `curves` and writes the svg in the same pass.
+         * The header is flushed first, then the curves are fitted in paint
+         * order, largest area first, in batches that double from
+         * `options.progressiveBatch`, each one written and flushed before the
+         * next is fitted. The document is the same as from fit() and
+         * writeSvg(), only the big background shapes arrive early.
+         */
+        void writeSvgProgressively(const std::vector<Contour> &contours, int sharpness,
+                                   const std::vector<Pixel> &colors, std::vector<Curve> &curves,
+                                   cv::Size original, cv::Size traced, SvgSink &sink,
+                                   ConversionContext &context) const;
+
+    private:
+        std::shared_ptr<ContextPool> contexts;
+
+        void runPipeline(const cv::Mat &image, PixelFormat format, SvgSink &sink, cv::Mat *edgePreview,
+                         ConversionContext &context) const;
+    };
+}
+
+#endif //AUTOSVG_WASM_AUTOSVGCONVERTER_HPP
@@ -0,0 +1,153 @@
+#include <cmath>
+#include <opencv2/core.hpp>
+
+#include "BoundaryTracer.hpp"
+
+using namespace std;
+
+namespace pi {
+    // Directions: east, south, west, north (y grows downwards).
+    static const int DX[4] = {1, 0, -1, 0};
+    static const int DY[4] = {0, 1, 0, -1};
+
+    // Pixels in front of a vertex, relative to the vertex, for each heading.
+    static const int AHEAD_LEFT[4][2] = {{0,  -1},
+                                         {0,  0},
+                                         {-1, 0},
+                                         {-1, -1}};
+    static const int AHEAD_RIGHT[4][2] = {{0,  0},
+                                          {-1, 0},
+                                          {-1, -1},
+                                          {0,  -1}};
+
+    // A horizontal crack belongs to the pixel below it (top edge) or above it
+    // (bottom edge); each side is traced exactly once.
+    static const uchar TOP_VISITED = 1;
+    static const uchar BOTTOM_VISITED = 2;
+
+    class LabelWalker {
+    private:
+        const cv::Mat &labels;
+        cv::Mat &visited;
+
+        inline bool inRegion(int x, int y, uchar label) const {
+            return x >= 0 && y >= 0 && x < labels.cols && y < labels.rows && labels.at<uchar>(y, x) == label;
+        }
+
+    public:
+        LabelWalker(const cv::Mat &labels, cv::Mat &visited) : labels(labels), visited(visited) {}
+
+        /**
+         * Walks one boundary keeping the region on the right hand side, starting
+         * at vertex (x, y) with heading `direction`. Returns the signed area.
+         */
+        double walk(int startX, int startY, int startDirection, uchar label, Contour &contour) {
+            int x = startX, y = startY, direction = startDirection;
+            long long area = 0;
+            do {
+                contour.emplace_back(x, y);
+                if (direction == 0) {
+                    visited.at<uchar>(y, x) |= TOP_VISITED;
+                } else if (direction == 2) {
+                    visited.at<uchar>(y - 1, x - 1) |= BOTTOM_VISITED;
+                }
+                const int nextX = x + DX[direction], nextY = y + DY[direction];
+                area += (long long) x * nextY - (long long) nextX * y;
+                x = nextX;
+                y = nextY;
+
+                const bool right = inRegion(x + AHEAD_RIGHT[direction][0], y + AHEAD_RIGHT[direction][1], label);
+                const bool left = inRegion(x + AHEAD_LEFT[direction][0], y + AHEAD_LEFT[direction][1], label);
+                if (left) {
+                    // Either the region wraps around this corner, or it continues
+                    // diagonally and 8-connectivity joins the two pixels.
+                    direction = (direction + 3) % 4;
+                } else if (!right) {
+                    direction = (direction + 1) % 4;
+                }
+            } while (x != startX || y != startY || direction != startDirection);
+            return area / 2.0;
+        }
+    };
+
+    void BoundaryTracer::trace(const cv::Mat &labels, double minArea, double maxArea,
+                               vector<Contour> *contours, vector<int> *contourLabels, cv::Mat *visited) {
+        CV_Assert(labels.type() == CV_8UC1);
+        cv::Mat ownVisited;
+        cv::Mat &marked = visited ? *visited : ownVisited;
+        marked.create(labels.rows, labels.cols, CV_8UC1);
+        marked.setTo(cv::Scalar(0));
+        LabelWalker walker(labels, marked);
+
+        size_t count = 0;
+        if (contourLabels != nullptr) {
+            contourLabels->clear();
+        }
+        // Boundaries are walked into the next free slot, which only advances
+        // when the boundary is kept.
+        auto slot = [&]() -> Contour & {
+            if (count == contours->size()) {
+                contours->emplace_back();
+            }
+            Contour &contour = (*contours)[count];
+            contour.clear();
+            return contour;
+        };
+        auto emit = [&](double area, uchar label) {
+            area = fabs(area);
+            if (area > minArea && area < maxArea) {
+                count++;
+                if (contourLabels != nullptr) {
+                    contourLabels->push_back(label);
+                }
+            }
+        };
+
+        for (int y = 0; y < labels.rows; y++) {
+            const auto *above = y > 0 ? labels.ptr<uchar>(y - 1) : nullptr;
+            const auto *row = labels.ptr<uchar>(y);
+            const auto *below = y + 1 < labels.rows ? labels.ptr<uchar>(y + 1) : nullptr;
+            const auto *marks = marked.ptr<uchar>(y);
+            for (int x = 0; x < labels.cols; x++) {
+                const auto label = row[x];
+                if ((above == nullptr || above[x] != label) && !(marks[x] & TOP_VISITED)) {
+                    emit(walker.walk(x, y, 0, label, slot()), label);
+                }
+                if ((below == nullptr || below[x] != label) && !(marks[x] & BOTTOM_VISITED)) {
+                    emit(walker.walk(x + 1, y + 1, 2, label, slot()), label);
+                }
+            }
+        }
+        contours->resize(count);
+    }
+
+    double BoundaryTracer::signedArea(const Contour &contour) {
+        long long area = 0;
+        for (size_t i = 0, j = contour.size() - 1; i < contour.size(); j = i++) {
+            area += (long long) contour[j].x * contour[i].y - (long long) contour[i].x * contour[j].y;
+        }
+        return area / 2.0;
+    }
+
+    cv::Point BoundaryTracer::leftPixel(const cv::Point &from, const cv::Point &to) {
+        if (to.x > from.x) {
+            return {from.x, from.y - 1};
+        }
+        if (to.y > from.y) {
+            return {from.x, from.y};
+        }
+        if (to.x < from.x) {
+            return {from.x - 1, from.y};
+        }
+        return {from.x - 1, from.y - 1};
+    }
+
+    int BoundaryTracer::insideLabel(const cv::Mat &labels, const Contour &contour, int label) {
+        if (BoundaryTracer::signedArea(contour) > 0) {
+            return label;
+        }
+        // Holes never touch the image border, so the pixel is always inside it.
+        const cv::Point inside = BoundaryTracer::leftPixel(contour[0], contour[1 % contour.size()]);
+        return labels.at<uchar>(inside.y, inside.x);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef AUTOSVG_WASM_BOUNDARYTRACER_HPP
+#define AUTOSVG_WASM_BOUNDARYTRACER_HPP
+
+#include <vector>
+#include <opencv2/core/mat.hpp>
+#include <utils/Constants.hpp>
+
+namespace pi {
+
+    /**
+     * Traces the boundaries of every region of a CV_8UC1 label map in one raster
+     * pass. Boundaries follow the cracks between pixels, so their vertices are
+     * pixel corners and a region's outline encloses exactly its pixels. Regions
+     * are 8-connected, like cv::findContours on a binary mask.
+     *
+     * Outer boundaries run clockwise and holes counter-clockwise on screen. Each
+     * boundary is reported once, with the label of the region it encloses or
+     * surrounds, in the raster order of its first pixel.
+     */
+    class BoundaryTracer {
+    public:
+        /**
+         * Replaces `contours` with the boundaries whose area lies between
+         * `minArea` and `maxArea`. Contours already in the vector are reused as
+         * storage. `visited` is optional scratch kept by the caller.
+         */
+        void static trace(const cv::Mat &labels, double minArea, double maxArea,
+                          std::vector<Contour> *contours, std::vector<int> *contourLabels,
+                          cv::Mat *visited = nullptr);
+
+        /**
+         * Positive for outer boundaries, negative for holes.
+         */
+        double static signedArea(const Contour &contour);
+
+        /**
+         * The pixel on the left of the unit edge from `from` to `to`, outside
+         * the region the boundary belongs to.
+         */
+        cv::Point static leftPixel(const cv::Point &from, const cv::Point &to);
+
+        /**
+         * Label the inside of a boundary of `label` is painted with: `label`
+         * for outer boundaries, the label of the enclosed pixels for holes.
+         */
+        int static insideLabel(const cv::Mat &labels, const Contour &contour, int label);
+    };
+}
+
+#endif //AUTOSVG_WASM_BOUNDARYTRACER_HPP
@@ -0,0 +1,301 @@
+#include <limits>
+#include <opencv2/core.hpp>
+
+#include "ColorQuantizer.hpp"
+#include "PaletteMapper.hpp"
+
+using namespace std;
+
+namespace pi {
+    static inline float colorDistance(const Pixel &a, const Pixel &b) {
+        const float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    static inline int nearestColor(const vector<Pixel> &palette, const Pixel &color, float *distance = nullptr) {
+        int nearest = 0;
+        float nearestDistance = numeric_limits<float>::max();
+        for (size_t j = 0; j < palette.size(); j++) {
+            auto d = colorDistance(palette[j], color);
+            if (d < nearestDistance) {
+                nearestDistance = d;
+                nearest = int(j);
+            }
+        }
+        if (distance != nullptr) {
+            *distance = nearestDistance;
+        }
+        return nearest;
+    }
+
+    static int sampleWeighted(const vector<double> &weights, double total, cv::RNG &rng) {
+        double target = rng.uniform(0., total);
+        for (size_t i = 0; i < weights.size(); i++) {
+            target -= weights[i];
+            if (target <= 0) {
+                return int(i);
+            }
+        }
+        return int(weights.size()) - 1;
+    }
+
+    static vector<Pixel> seedCenters(const ColorHistogram &histogram, unsigned int k, cv::RNG &rng) {
+        const auto &colors = histogram.colors;
+        vector<double> weights(histogram.weights.begin(), histogram.weights.end());
+        double total = 0;
+        for (auto w : weights) {
+            total += w;
+        }
+
+        vector<Pixel> centers;
+        centers.push_back(colors[sampleWeighted(weights, total, rng)]);
+
+        vector<float> nearest(colors.size(), numeric_limits<float>::max());
+        while (centers.size() < k) {
+            total = 0;
+            for (size_t i = 0; i < colors.size(); i++) {
+                nearest[i] = min(nearest[i], colorDistance(colors[i], centers.back()));
+                weights[i] = histogram.weights[i] * nearest[i];
+                total += weights[i];
+            }
+            if (total <= 0) {
+                break;
+            }
+            centers.push_back(colors[sampleWeighted(weights, total, rng)]);
+        }
+        return centers;
+    }
+
+    ColorHistogram ColorQuantizer::buildHistogram(const cv::Mat &src) {
+        HistogramScratch scratch;
+        ColorQuantizer::buildHistogram(src, scratch);
+        return std::move(scratch.histogram);
+    }
+
+    void ColorQuantizer::buildHistogram(const cv::Mat &src, HistogramScratch &scratch) {
+        ColorQuantizer::clearHistogram(scratch);
+        ColorQuantizer::accumulateHistogram(src, scratch);
+        ColorQuantizer::collectHistogram(scratch);
+    }
+
+    void ColorQuantizer::clearHistogram(HistogramScratch &scratch) {
+        const int binCount = 1 << (3 * HISTOGRAM_BITS);
+        scratch.counts.assign(binCount, 0);
+        scratch.sums.assign(binCount, cv::Vec<uint64_t, 3>());
+    }
+
+    void ColorQuantizer::accumulateHistogram(const cv::Mat &src, HistogramScratch &scratch) {
+        auto &counts = scratch.counts;
+        auto &sums = scratch.sums;
+        const auto channels = src.channels();
+        for (int row = 0; row < src.rows; row++) {
+            const auto *pixel = src.ptr<uchar>(row);
+            for (int col = 0; col < src.cols; col++, pixel += channels) {
+                auto bin = ColorQuantizer::binIndex(pixel);
+                counts[bin]++;
+                sums[bin][0] += pixel[0];
+                sums[bin][1] += pixel[1];
+                sums[bin][2] += pixel[2];
+            }
+        }
+    }
+
+    void ColorQuantizer::collectHistogram(HistogramScratch &scratch) {
+        const auto &counts = scratch.counts;
+        const auto &sums = scratch.sums;
+        ColorHistogram &histogram = scratch.histogram;
+        histogram.colors.clear();
+        histogram.weights.clear();
+        histogram.bins.clear();
+        for (int bin = 0; bin < (int) counts.size(); bin++) {
+            if (counts[bin] == 0) {
+                continue;
+            }
+            const auto count = double(counts[bin]);
+            histogram.colors.emplace_back(sums[bin][0] / count, sums[bin][1] / count, sums[bin][2] / count);
+            histogram.weights.push_back(float(count));
+            histogram.bins.push_back(bin);
+        }
+    }
+
+    /**
+     * Weighted Lloyd iterations on the histogram bins from `centers`, which
+     * are updated in place. Returns the weighted squared error of the last
+     * assignment.
+     */
+    static double refineCenters(const ColorHistogram &histogram, vector<Pixel> &centers) {
+        const auto &colors = histogram.colors;
+        const auto &weights = histogram.weights;
+        vector<int> labels(colors.size());
+        vector<float> distances(colors.size());
+        vector<cv::Vec3d> sums(centers.size());
+        vector<double> clusterWeights(centers.size());
+        double compactness = 0;
+
+        for (int iteration = 0; iteration < HISTOGRAM_MAX_ITERATIONS; iteration++) {
+            bool changed = false;
+            compactness = 0;
+            for (size_t i = 0; i < colors.size(); i++) {
+                auto label = nearestColor(centers, colors[i], &distances[i]);
+                changed |= labels[i] != label;
+                labels[i] = label;
+                compactness += weights[i] * distances[i];
+            }
+            if (!changed && iteration > 0) {
+                break;
+            }
+
+            fill(sums.begin(), sums.end(), cv::Vec3d());
+            fill(clusterWeights.begin(), clusterWeights.end(), 0.0);
+            for (size_t i = 0; i < colors.size(); i++) {
+                auto &sum = sums[labels[i]];
+                sum[0] += weights[i] * colors[i].x;
+                sum[1] += weights[i] * colors[i].y;
+                sum[2] += weights[i] * colors[i].z;
+                clusterWeights[labels[i]] += weights[i];
+            }
+            for (size_t j = 0; j < centers.size(); j++) {
+                if (clusterWeights[j] > 0) {
+                    centers[j] = Pixel(float(sums[j][0] / clusterWeights[j]),
+                                       float(sums[j][1] / clusterWeights[j]),
+                                       float(sums[j][2] / clusterWeights[j]));
+                    continue;
+                }
+                // Empty cluster, restart it on the worst represented bin.
+                size_t worst = 0;
+                for (size_t i = 1; i < colors.size(); i++) {
+                    if (weights[i] * distances[i] > weights[worst] * distances[worst]) {
+                        worst = i;
+                    }
+                }
+                centers[j] = colors[worst];
+                distances[worst] = 0;
+            }
+        }
+        return compactness;
+    }
+
+    vector<Pixel> ColorQuantizer::clusterHistogram(const ColorHistogram &histogram, unsigned int k) {
+        if (histogram.colors.size() <= k) {
+            return histogram.colors;
+        }
+
+        // Fixed seed, so the same image always produces the same palette.
+        cv::RNG rng(0x5eed);
+        vector<Pixel> best;
+        double bestCompactness = numeric_limits<double>::max();
+        for (int attempt = 0; attempt < HISTOGRAM_ATTEMPTS; attempt++) {
+            auto centers = seedCenters(histogram, k, rng);
+            const double compactness = refineCenters(histogram, centers);
+            if (compactness < bestCompactness) {
+                bestCompactness = compactness;
+                best = centers;
+            }
+        }
+        return best;
+    }
+
+    ColorHistogram ColorQuantizer::coarsenHistogram(const ColorHistogram &histogram, int bits) {
+        const int shift = HISTOGRAM_BITS - bits;
+        const int mask = (1 << HISTOGRAM_BITS) - 1;
+        vector<int> coarseBins(size_t(1) << (3 * bits), -1);
+        ColorHistogram coarse;
+        for (size_t i = 0; i < histogram.colors.size(); i++) {
+            const int bin = histogram.bins[i];
+            const int coarseBin = (((bin >> (2 * HISTOGRAM_BITS)) >> shift) << (2 * bits)) |
+                                  ((((bin >> HISTOGRAM_BITS) & mask) >> shift) << bits) |
+                                  ((bin & mask) >> shift);
+            int &index = coarseBins[coarseBin];
+            const float weight = histogram.weights[i];
+            if (index < 0) {
+                index = int(coarse.colors.size());
+                coarse.colors.push_back(histogram.colors[i] * weight);
+                coarse.weights.push_back(weight);
+                coarse.bins.push_back(coarseBin);
+                continue;
+            }
+            coarse.colors[index] += histogram.colors[i] * weight;
+            coarse.weights[index] += weight;
+        }
+        for (size_t i = 0; i < coarse.colors.size(); i++) {
+            coarse.colors[i] *= 1.f / coarse.weights[i];
+        }
+        return coarse;
+    }
+
+    vector<Pixel> ColorQuantizer::autoClusterHistogram(const ColorHistogram &histogram, unsigned int maxK) {
+        if (histogram.colors.empty()) {
+            return {};
+        }
+        // The search runs on a coarser histogram, a fraction of the bins.
+        const ColorHistogram sample = coarsenHistogram(histogram, AUTO_K_HISTOGRAM_BITS);
+        const auto &colors = sample.colors;
+        const auto &weights = sample.weights;
+        double total = 0;
+        for (auto weight : weights) {
+            total += weight;
+        }
+
+        vector<Pixel> centers(1, Pixel(0, 0, 0));
+        for (size_t i = 0; i < colors.size(); i++) {
+            centers[0] += colors[i] * (weights[i] / float(total));
+        }
+        double error = refineCenters(sample, centers);
+
+        while (centers.size() < min(size_t(maxK), colors.size()) && error / total > AUTO_K_MIN_ERROR) {
+            // Warm start: the previous centers stay, the new one starts on the
+            // bin that contributes most to the current error.
+            size_t worst = 0;
+            float worstError = -1;
+            for (size_t i = 0; i < colors.size(); i++) {
+                float distance;
+                nearestColor(centers, colors[i], &distance);
+                if (weights[i] * distance > worstError) {
+                    worstError = weights[i] * distance;
+                    worst = i;
+                }
+            }
+            vector<Pixel> grown = centers;
+            grown.push_back(colors[worst]);
+            const double grownError = refineCenters(sample, grown);
+            // Stop once another color no longer pays for itself.
+            if (error - grownError < error * AUTO_K_MIN_IMPROVEMENT) {
+                break;
+            }
+            centers.swap(grown);
+            error = grownError;
+        }
+
+        // One warm started pass on the full histogram settles the centers.
+        refineCenters(histogram, centers);
+        return centers;
+    }
+
+    vector<cv::Vec3b> ColorQuantizer::histogramPalette(const ColorHistogram &histogram, unsigned int k) {
+        auto centers = k == AUTO_K_COLORS
+                       ? ColorQuantizer::autoClusterHistogram(histogram, AUTO_K_MAX_COLORS)
+                       : ColorQuantizer::clusterHistogram(histogram, min(k, (unsigned int) MAX_K_COLORS));
+
+        // Round the palette up front so the output pixels match the returned colors exactly.
+        vector<cv::Vec3b> palette;
+        for (const auto &center : centers) {
+            palette.emplace_back(cv::saturate_cast<uchar>(center.x),
+                                 cv::saturate_cast<uchar>(center.y),
+                                 cv::saturate_cast<uchar>(center.z));
+        }
+        return palette;
+    }
+
+    cv::Mat ColorQuantizer::histogramSegmentation(cv::Mat *src, cv::Mat *out, unsigned int k, cv::Mat *labels,
+                                                  HistogramScratch *scratch) {
+        HistogramScratch ownScratch;
+        HistogramScratch &histogram = scratch ? *scratch : ownScratch;
+        ColorQuantizer::buildHistogram(*src, histogram);
+        const auto palette = ColorQuantizer::histogramPalette(histogram.histogram, k);
+
+        // Writing straight into the caller's matrices lets them keep their buffers.
+        cv::Mat labelMap;
+        PaletteMapper::assignLabels(*src, palette, labels != nullptr ? labels : &labelMap, out);
+        return PaletteMapper::toColors(palette);
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef AUTOSVG_WASM_COLORQUANTIZER_HPP
+#define AUTOSVG_WASM_COLORQUANTIZER_HPP
+
+#include <vector>
+#include <opencv2/core/mat.hpp>
+#include <utils/Constants.hpp>
+
+#define HISTOGRAM_BITS 5
+#define HISTOGRAM_ATTEMPTS 3
+#define HISTOGRAM_MAX_ITERATIONS 100
+// Automatic color count: the largest palette searched, the histogram bits the
+// search runs on, the relative error reduction a further color has to bring
+// and the mean squared error per pixel below which no color is added.
+#define AUTO_K_MAX_COLORS 16
+#define AUTO_K_HISTOGRAM_BITS 4
+#define AUTO_K_MIN_IMPROVEMENT 0.1
+#define AUTO_K_MIN_ERROR 16
+
+namespace pi {
+
+    /**
+     * Color histogram of an 8 bit image, reduced to HISTOGRAM_BITS per channel.
+     * Each occupied bin keeps the mean color of the pixels that fell into it
+     * and how many of them there were.
+     */
+    struct ColorHistogram {
+        std::vector<Pixel> colors;
+        std::vector<float> weights;
+        std::vector<int> bins;
+    };
+
+    /**
+     * Buffers of histogramSegmentation that can be kept between images.
+     */
+    struct HistogramScratch {
+        std::vector<uint32_t> counts;
+        std::vector<cv::Vec<uint64_t, 3>> sums;
+        ColorHistogram histogram;
+    };
+
+    class ColorQuantizer {
+    public:
+        /**
+         * Drop-in replacement for Operations::kMeanSegmentation that clusters the
+         * weighted histogram bins with k-means++ instead of every pixel, then
+         * assigns every pixel to its nearest palette entry.
+         */
+        cv::Mat static histogramSegmentation(cv::Mat *src, cv::Mat *out, unsigned int k, cv::Mat *labels = nullptr,
+                                             HistogramScratch *scratch = nullptr);
+
+        ColorHistogram static buildHistogram(const cv::Mat &src);
+
+        /**
+         * Builds the histogram of `src` into `scratch.histogram`.
+         */
+        void static buildHistogram(const cv::Mat &src, HistogramScratch &scratch);
+
+        /**
+         * Building a histogram in parts, e.g. tile by tile: clear once, add
+         * every part, then collect the occupied bins into `scratch.histogram`.
+         */
+        void static clearHistogram(HistogramScratch &scratch);
+
+        void static accumulateHistogram(const cv::Mat &src, HistogramScratch &scratch);
+
+        void static collectHistogram(HistogramScratch &scratch);
+
+        /**
+         * Clusters a collected histogram into at most `k` colors, rounded to
+         * the 8 bit values the quantized image uses. With AUTO_K_COLORS the
+         * count is chosen by autoClusterHistogram().
+         */
+        std::vector<cv::Vec3b> static histogramPalette(const ColorHistogram &histogram, unsigned int k);
+
+        std::vector<Pixel> static clusterHistogram(const ColorHistogram &histogram, unsigned int k);
+
+        /**
+         * Picks the number of colors as well: starting from one, each step
+         * keeps the previous centers, adds one on the worst represented bin and
+         * refines, until the error improves by less than AUTO_K_MIN_IMPROVEMENT,
+         * drops below AUTO_K_MIN_ERROR or `maxK` is reached. The search runs on
+         * the histogram coarsened to AUTO_K_HISTOGRAM_BITS, so it costs about as
+         * much as one clusterHistogram() call.
+         */
+        std::vector<Pixel> static autoClusterHistogram(const ColorHistogram &histogram, unsigned int maxK);
+
+        /**
+         * Merges the bins of `histogram` into a histogram of `bits` per channel.
+         */
+        ColorHistogram static coarsenHistogram(const ColorHistogram &histogram, int bits);
+
+        static inline int binIndex(const uchar *pixel) {
+            const int shift = 8 - HISTOGRAM_BITS;
+            return ((pixel[0] >> shift) << (2 * HISTOGRAM_BITS)) |
+                   ((pixel[1] >> shift) << HISTOGRAM_BITS) |
+                   (pixel[2] >> shift);
+        }
+    };
+}
+
+#endif //AUTOSVG_WASM_COLORQUANTIZER_HPP
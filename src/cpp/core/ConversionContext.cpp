@@ -0,0 +1,69 @@
+#include "ConversionContext.hpp"
+
+using namespace std;
+
+namespace pi {
+    void ConversionContext::release() {
+        // Move assignment frees what the buffers held.
+        *this = ConversionContext();
+    }
+
+    static size_t matBytes(const cv::Mat &mat) {
+        return mat.u ? mat.u->size : mat.total() * mat.elemSize();
+    }
+
+    static size_t contourBytes(const vector<Contour> &contours) {
+        size_t bytes = contours.capacity() * sizeof(Contour);
+        for (const auto &contour : contours) {
+            bytes += contour.capacity() * sizeof(cv::Point);
+        }
+        return bytes;
+    }
+
+    size_t ConversionContext::heldBytes() const {
+        size_t bytes = matBytes(resized) + matBytes(rgb) + matBytes(quantized) + matBytes(visited) +
+                       matBytes(regionLabels) + matBytes(coarseLabels) + matBytes(coarseBand) + matBytes(band) +
+                       matBytes(segments.labels);
+        bytes += histogram.counts.capacity() * sizeof(uint32_t) +
+                 histogram.sums.capacity() * sizeof(cv::Vec<uint64_t, 3>);
+        bytes += contourBytes(segments.edges) + segments.edgeLabels.capacity() * sizeof(int) +
+                 colors.capacity() * sizeof(Pixel) + paintOrder.capacity() * sizeof(size_t);
+        bytes += curves.capacity() * sizeof(Curve);
+        for (const auto &curve : curves) {
+            bytes += curve.segments.capacity() * sizeof(CurveSegment);
+            for (const auto &segment : curve.segments) {
+                bytes += segment.capacity() * sizeof(cv::Point2f);
+            }
+        }
+        return bytes + svgBuffer.capacity();
+    }
+
+    unique_ptr<ConversionContext> ContextPool::acquire() {
+        {
+            lock_guard<std::mutex> lock(mutex);
+            if (!idle.empty()) {
+                auto context = std::move(idle.back());
+                idle.pop_back();
+                return context;
+            }
+        }
+        return unique_ptr<ConversionContext>(new ConversionContext());
+    }
+
+    void ContextPool::release(unique_ptr<ConversionContext> context) {
+        if (!context) {
+            return;
+        }
+        // Measured outside the lock, the context is not shared yet.
+        if (context->heldBytes() > CONTEXT_MAX_IDLE_BYTES) {
+            context->release();
+        }
+        lock_guard<std::mutex> lock(mutex);
+        idle.push_back(std::move(context));
+    }
+
+    void ContextPool::clear() {
+        lock_guard<std::mutex> lock(mutex);
+        idle.clear();
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef AUTOSVG_WASM_CONVERSIONCONTEXT_HPP
+#define AUTOSVG_WASM_CONVERSIONCONTEXT_HPP
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+#include <utils/Constants.hpp>
+#include <utils/AdaptiveFitting.hpp>
+#include "ColorQuantizer.hpp"
+
+// Idle contexts holding more scratch memory than this are emptied when they
+// return to their pool, so one large image does not keep every worker at its
+// peak for good.
+#define CONTEXT_MAX_IDLE_BYTES (64 << 20)
+
+namespace pi {
+
+    /**
+     * Scratch memory of one conversion at a time.
+     *
+     * Every stage writes into these buffers instead of fresh ones, and contours,
+     * curves and segments are cleared rather than freed, so their capacity acts
+     * as an arena for the geometry of the next image. Once a context has seen an
+     * image, converting another of a similar size allocates almost nothing.
+     */
+    class ConversionContext {
+    public:
+        cv::Mat resized;
+        cv::Mat rgb;
+        cv::Mat quantized;
+        cv::Mat visited;
+        cv::Mat regionLabels;
+        cv::Mat coarseLabels;
+        cv::Mat coarseBand;
+        cv::Mat band;
+        HistogramScratch histogram;
+        SegmentedEdgeResult segments;
+        std::vector<Pixel> colors;
+        std::vector<Curve> curves;
+        std::vector<size_t> paintOrder;
+        std::vector<AdaptiveFitting> fitters;
+        std::vector<char> svgBuffer;
+
+        /**
+         * Returns all held memory, e.g. after an unusually large image.
+         */
+        void release();
+
+        /**
+         * Estimate of the memory the buffers hold, from the pixel buffers and
+         * the capacity of the geometry.
+         */
+        size_t heldBytes() const;
+    };
+
+    /**
+     * Idle contexts shared by the conversions of a converter. A context is
+     * leased for the duration of one conversion, so concurrent conversions
+     * never share scratch memory. Contexts returned with more than
+     * CONTEXT_MAX_IDLE_BYTES are released before they are pooled.
+     */
+    class ContextPool {
+    public:
+        std::unique_ptr<ConversionContext> acquire();
+
+        void release(std::unique_ptr<ConversionContext> context);
+
+        /**
+         * Drops every idle context.
+         */
+        void clear();
+
+    private:
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ConversionContext>> idle;
+    };
+
+    /**
+     * Returns a leased context to its pool, also when the conversion throws.
+     */
+    class ContextLease {
+    public:
+        explicit ContextLease(ContextPool &pool) : pool(pool), context(pool.acquire()) {}
+
+        ~ContextLease() {
+            pool.release(std::move(context));
+        }
+
+        ContextPool &pool;
+        std::unique_ptr<ConversionContext> context;
+    };
+}
+
+#endif //AUTOSVG_WASM_CONVERSIONCONTEXT_HPP
@@ -0,0 +1,137 @@
+#include <stdexcept>
+
+#include "ConversionSession.hpp"
+#include "Operations.hpp"
+#include <utils/CurveUtils.hpp>
+
+using namespace std;
+
+namespace pi {
+    /**
+     * Drops the least recently used entry once `cache` holds more than
+     * `capacity`, never the one just used.
+     */
+    template<typename Cache>
+    static void evict(Cache &cache, size_t capacity) {
+        while (cache.size() > capacity) {
+            auto oldest = cache.begin();
+            for (auto it = cache.begin(); it != cache.end(); ++it) {
+                if (it->second.used < oldest->second.used) {
+                    oldest = it;
+                }
+            }
+            cache.erase(oldest);
+        }
+    }
+
+    ConversionSession::ConversionSession(const ConversionOptions &options) : converter(options) {
+        converter.options.tileSize = 0;
+        converter.options.pyramid = false;
+    }
+
+    void ConversionSession::setImage(const cv::Mat &source, PixelFormat format) {
+        segmentations.clear();
+        fittings.clear();
+        originalSize = source.size();
+        image = converter.prepareImage(source, format, context);
+        // Without a resize or color conversion the caller's pixels come back.
+        if (image.data == source.data) {
+            image = image.clone();
+        }
+        // The image keeps its buffer, the next setImage() prepares into new ones.
+        context.resized = cv::Mat();
+        context.rgb = cv::Mat();
+    }
+
+    bool ConversionSession::hasImage() const {
+        return !image.empty();
+    }
+
+    void ConversionSession::convert(int colors, int sharpness, SvgSink &sink, cv::Mat *edgePreview) {
+        if (!hasImage()) {
+            throw invalid_argument("ConversionSession: no image set");
+        }
+        const Segmentation &segments = segmentation(colors);
+        if (edgePreview) {
+            Operations::drawEdges(segments.segments.edges, image.size(), edgePreview);
+        }
+        const auto key = make_pair(colors, sharpness);
+        if (converter.options.progressiveBatch > 0 && fittings.find(key) == fittings.end()) {
+            // Only cached once written, a failing sink leaves no partial curves behind.
+            Fitting fitted;
+            converter.writeSvgProgressively(segments.segments.edges, sharpness, segments.colors, fitted.curves,
+                                            originalSize, image.size(), sink, context);
+            fitted.used = ++clock;
+            fittings[key] = std::move(fitted);
+            evict(fittings, SESSION_CACHED_CURVES);
+            return;
+        }
+        const Fitting &fitted = fitting(colors, sharpness, segments);
+        converter.writeSvg(fitted.curves, originalSize, image.size(), sink, context);
+    }
+
+    void ConversionSession::setProgressiveBatch(size_t batch) {
+        converter.options.progressiveBatch = batch;
+    }
+
+    string ConversionSession::convertToSvg(int colors, int sharpness) {
+        BufferSink sink;
+        convert(colors, sharpness, sink);
+        return std::move(sink.buffer);
+    }
+
+    void ConversionSession::clearCache() {
+        segmentations.clear();
+        fittings.clear();
+        context = ConversionContext();
+    }
+
+    ConversionSession::Segmentation &ConversionSession::segmentation(int colors) {
+        auto found = segmentations.find(colors);
+        if (found != segmentations.end()) {
+            found->second.used = ++clock;
+            return found->second;
+        }
+
+        // Cached only once complete, a stage that throws leaves no entry behind.
+        Segmentation segmented;
+        converter.options.colors = colors;
+        converter.segment(image, nullptr, context);
+        // Moved out, the context's buffers are only scratch for the next miss.
+        segmented.segments = std::move(context.segments);
+        segmented.colors = std::move(context.colors);
+        context.segments = SegmentedEdgeResult();
+        context.colors.clear();
+        segmented.used = ++clock;
+        Segmentation &entry = segmentations[colors] = std::move(segmented);
+        evict(segmentations, SESSION_CACHED_SEGMENTATIONS);
+        return entry;
+    }
+
+    ConversionSession::Fitting &ConversionSession::fitting(int colors, int sharpness,
+                                                           const Segmentation &segmentation) {
+        const auto key = make_pair(colors, sharpness);
+        auto found = fittings.find(key);
+        if (found != fittings.end()) {
+            found->second.used = ++clock;
+            return found->second;
+        }
+
+        const ConversionOptions &options = converter.options;
+        Fitting fitted;
+        {
+            ProfileScope fit(options.profiler, "fit");
+            CurveUtils::convertContoursToBezierCurves(segmentation.segments.edges, sharpness, segmentation.colors,
+                                                      options.fitting, fitted.curves, context.fitters);
+            size_t segments = 0;
+            for (const auto &curve : fitted.curves) {
+                segments += curve.segments.size();
+            }
+            fit.items(segments);
+        }
+        fitted.used = ++clock;
+        Fitting &entry = fittings[key] = std::move(fitted);
+        evict(fittings, SESSION_CACHED_CURVES);
+        return entry;
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef AUTOSVG_WASM_CONVERSIONSESSION_HPP
+#define AUTOSVG_WASM_CONVERSIONSESSION_HPP
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+#include <utils/Constants.hpp>
+#include <utils/SvgWriter.hpp>
+#include "AutosvgConverter.hpp"
+#include "ConversionContext.hpp"
+
+namespace pi {
+
+    /**
+     * Converts one image over and over with changing parameters, e.g. while
+     * the user drags a slider.
+     *
+     * The working image is prepared once per setImage(). The segmentation
+     * (label map, contours and their colors) is cached per color count and
+     * the fitted curves per color count and sharpness, so a new sharpness only
+     * fits again and a color count seen before only serializes. Both caches
+     * drop their least recently used entry beyond SESSION_CACHED_SEGMENTATIONS
+     * and SESSION_CACHED_CURVES.
+     *
+     * Sessions always use the resized pipeline, `options.tileSize` and
+     * `options.pyramid` are ignored. A session is not thread safe.
+     */
+    class ConversionSession {
+    public:
+        explicit ConversionSession(const ConversionOptions &options = ConversionOptions());
+
+        /**
+         * Replaces the image and clears both caches. The pixels are copied, the
+         * caller may reuse them right away.
+         */
+        void setImage(const cv::Mat &image, PixelFormat format);
+
+        bool hasImage() const;
+
+        /**
+         * Converts the current image with `colors` and `sharpness`, running only
+         * the stages whose result is not cached. `edgePreview` receives the
+         * traced edges as an RGB image of the working size. With
+         * `options.progressiveBatch` curves that are not cached yet are written
+         * while they are fitted.
+         */
+        void convert(int colors, int sharpness, SvgSink &sink, cv::Mat *edgePreview = nullptr);
+
+        /**
+         * Changes `options.progressiveBatch` of later conversions.
+         */
+        void setProgressiveBatch(size_t batch);
+
+        std::string convertToSvg(int colors, int sharpness);
+
+        /**
+         * Frees the cached stages and the scratch buffers, the image is kept.
+         */
+        void clearCache();
+
+    private:
+        struct Segmentation {
+            SegmentedEdgeResult segments;
+            std::vector<Pixel> colors;
+            unsigned long used = 0;
+        };
+
+        struct Fitting {
+            std::vector<Curve> curves;
+            unsigned long used = 0;
+        };
+
+        AutosvgConverter converter;
+        ConversionContext context;
+        cv::Mat image;
+        cv::Size originalSize;
+        std::map<int, Segmentation> segmentations;
+        std::map<std::pair<int, int>, Fitting> fittings;
+        unsigned long clock = 0;
+
+        Segmentation &segmentation(int colors);
+
+        Fitting &fitting(int colors, int sharpness, const Segmentation &segmentation);
+    };
+}
+
+#endif //AUTOSVG_WASM_CONVERSIONSESSION_HPP
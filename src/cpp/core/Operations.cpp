@@ -2,39 +2,72 @@
 // Created by Anuj Kosambi on 20/05/20.
 //
 
+#include <algorithm>
 #include <opencv2/core.hpp>
 #include <opencv2/opencv.hpp>
-#include <utils/underscore.hpp>
 #include <NumCpp.hpp>
+#include <numeric>
 
 #include "Operations.hpp"
+#include "ColorQuantizer.hpp"
+#include "PaletteMapper.hpp"
+#include "BoundaryTracer.hpp"
+#include "ConversionContext.hpp"
 
 using namespace std;
 
 namespace pi {
-    cv::Mat Operations::kMeanSegmentation(cv::Mat *src, cv::Mat *out, unsigned int k) {
-        cv::Mat data = src->reshape(1, src->rows * src->cols);
+    cv::Mat Operations::kMeanSegmentation(cv::Mat *src, cv::Mat *out, unsigned int k, cv::Mat *labels) {
+        k = min(max(k, 1u), (unsigned int) MAX_K_COLORS);
+        cv::Mat pixels = *src;
+        // Alpha must not pull the clusters apart.
+        if (pixels.channels() == 4) {
+            cv::cvtColor(pixels, pixels, cv::COLOR_RGBA2RGB);
+        }
+        cv::Mat data = pixels.reshape(1, src->rows * src->cols);
         data.convertTo(data, CV_32F);
-        std::vector<int> labels;
+        std::vector<int> bestLabels;
         cv::Mat1f colors;
 
         cv::kmeans(data,
                    k,
-                   labels,
+                   bestLabels,
                    cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::MAX_ITER, 100, 1),
                    10,
                    cv::KMEANS_PP_CENTERS,
                    colors);
-        for (unsigned int i = 0; i < src->rows * src->cols; i++) {
-            data.at<float>(i, 0) = colors(labels[i], 0);
-            data.at<float>(i, 1) = colors(labels[i], 1);
-            data.at<float>(i, 2) = colors(labels[i], 2);
+
+        cv::Mat labelMap(src->rows, src->cols, CV_8UC1);
+        for (int row = 0, i = 0; row < src->rows; row++) {
+            auto *label = labelMap.ptr<uchar>(row);
+            for (int col = 0; col < src->cols; col++, i++) {
+                label[col] = (uchar) bestLabels[i];
+            }
         }
 
-        cv::Mat outputImage = data.reshape(3, src->rows);
-        outputImage.convertTo(outputImage, CV_8U);
+        auto palette = PaletteMapper::toPalette(colors.reshape(3, k));
+        cv::Mat outputImage;
+        PaletteMapper::remapLabels(labelMap, palette, &outputImage);
         *out = outputImage;
-        return colors.reshape(3, k);
+        if (labels != nullptr) {
+            *labels = labelMap;
+        }
+        return PaletteMapper::toColors(palette);
+    }
+
+    cv::Mat Operations::colorSegmentation(cv::Mat *src, cv::Mat *out, unsigned int k, QuantizationEngine engine,
+                                          cv::Mat *labels, HistogramScratch *scratch) {
+        // The color count is only searched on the histogram.
+        if (k == AUTO_K_COLORS) {
+            engine = HISTOGRAM_QUANTIZATION;
+        }
+        switch (engine) {
+            case KMEANS_QUANTIZATION:
+                return Operations::kMeanSegmentation(src, out, k, labels);
+            case HISTOGRAM_QUANTIZATION:
+            default:
+                return ColorQuantizer::histogramSegmentation(src, out, k, labels, scratch);
+        }
     }
 
     void Operations::sharpen(cv::Mat *src, cv::Mat *out, unsigned int k) {
@@ -43,52 +76,166 @@ namespace pi {
         cv::addWeighted(*src, 1.5, blur, -0.5, 0, *out);
     }
 
-    SegmentedEdgeResult Operations::findColorSegmentedEdge(cv::Mat *src, cv::Mat *out, unsigned int k) {
-        auto *kMean = new cv::Mat;
+    vector<Contour> Operations::findLabelContours(const cv::Mat &labels, int labelCount, vector<int> *edgeLabels) {
+        const auto imageArea = labels.rows * labels.cols;
+        vector<vector<Contour>> perLabel(labelCount);
+
+        // Each label writes only into its own slot, and the slots are merged in
+        // label order, so the output is the same for any number of threads.
+        cv::parallel_for_(cv::Range(0, labelCount), [&](const cv::Range &range) {
+            cv::Mat mask;
+            vector<Contour> contours;
+            vector<Hierarchy> hierarchy;
+            for (int label = range.start; label < range.end; label++) {
+                cv::compare(labels, label, mask, cv::CMP_EQ);
+                cv::findContours(mask, contours, hierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_NONE);
+                // Filtered in place, the kept contours are moved rather than copied.
+                contours.erase(remove_if(contours.begin(), contours.end(), [imageArea](const Contour &contour) {
+                    auto area = cv::contourArea(contour);
+                    return area <= MINIMUM_CONTOUR_AREA || area >= imageArea * MAXIMUM_CONTOUR_TO_IMAGE_RATIO;
+                }), contours.end());
+                perLabel[label] = std::move(contours);
+            }
+        });
+
+        vector<Contour> edges;
+        for (int label = 0; label < labelCount; label++) {
+            for (auto &contour : perLabel[label]) {
+                edges.push_back(std::move(contour));
+                if (edgeLabels != nullptr) {
+                    edgeLabels->push_back(label);
+                }
+            }
+        }
+        return edges;
+    }
 
-        cv::Mat edge(src->rows, src->cols, CV_8UC1, cv::Scalar(0, 0, 0));
+    vector<Contour> Operations::traceLabelBoundaries(const cv::Mat &labels, vector<int> *edgeLabels) {
+        vector<Contour> edges;
+        Operations::traceLabelBoundaries(labels, edges, edgeLabels);
+        return edges;
+    }
 
-        auto *edges = new vector<Contour>();
-        auto *result = new SegmentedEdgeResult;
+    void Operations::traceLabelBoundaries(const cv::Mat &labels, vector<Contour> &edges, vector<int> *edgeLabels,
+                                          cv::Mat *visited) {
+        const auto imageArea = labels.rows * labels.cols;
+        BoundaryTracer::trace(labels, MINIMUM_CONTOUR_AREA, imageArea * MAXIMUM_CONTOUR_TO_IMAGE_RATIO,
+                              &edges, edgeLabels, visited);
+    }
 
-        auto colors = Operations::kMeanSegmentation(src, kMean, k);
-        colors.forEach<Pixel>([kMean, edges](Pixel &pixel, const int *position) -> void {
-                                  cv::Mat mask;
-                                  const auto imageArea = kMean->rows * kMean->cols;
-                                  const auto &color = cv::Scalar(pixel.x, pixel.y, pixel.z);
-                                  cv::inRange(*kMean, color, color,
-                                              mask);
-                                  vector<Contour> contours;
-                                  vector<Hierarchy> hierarchy;
+    SegmentedEdgeResult Operations::findColorSegmentedEdge(cv::Mat *src, cv::Mat *out, unsigned int k,
+                                                            QuantizationEngine engine, TracingEngine tracer,
+                                                            Profiler *profiler) {
+        ConversionContext context;
+        Operations::findColorSegmentedEdge(src, out, k, engine, tracer, profiler, context);
+        return std::move(context.segments);
+    }
 
-                                  cv::findContours(mask, contours, hierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_NONE);
-                                  contours = underscore::filter<vector<Contour>>(contours, [imageArea](Contour contour) -> bool {
-                                      auto area = cv::contourArea(contour);
-                                      return area > MINIMUM_CONTOUR_AREA &&
-                                             area < imageArea * MAXIMUM_CONTOUR_TO_IMAGE_RATIO;
-                                  });
-                                  edges->insert(edges->end(), contours.begin(), contours.end());
-                                  return;
-                              }
-        );
+    void Operations::findColorSegmentedEdge(cv::Mat *src, cv::Mat *out, unsigned int k, QuantizationEngine engine,
+                                            TracingEngine tracer, Profiler *profiler, ConversionContext &context,
+                                            const vector<cv::Vec3b> *palette) {
+        SegmentedEdgeResult &result = context.segments;
+
+        {
+            ProfileScope quantize(profiler, "quantize");
+            quantize.items(src->total());
+            if (palette && !palette->empty()) {
+                // A single assignment pass, there is nothing to cluster.
+                PaletteMapper::assignLabels(*src, *palette, &result.labels, &context.quantized);
+                result.colors = PaletteMapper::toColors(*palette);
+            } else {
+                result.colors = Operations::colorSegmentation(src, &context.quantized, k, engine, &result.labels,
+                                                              &context.histogram);
+            }
+        }
 
-        result->colors = colors;
+        ProfileScope trace(profiler, "trace");
+        if (tracer == CONTOUR_TRACING) {
+            result.edgeLabels.clear();
+            result.edges = Operations::findLabelContours(result.labels, (int) result.colors.size(),
+                                                         &result.edgeLabels);
+        } else {
+            Operations::traceLabelBoundaries(result.labels, result.edges, &result.edgeLabels, &context.visited);
+        }
+        trace.items(result.edges.size());
 
-        result->edges = *edges;
+        if (out) {
+            Operations::drawEdges(result.edges, src->size(), out);
+        }
+    }
 
-        cv::drawContours(edge, *edges, -1, cv::Scalar(255));
+    void Operations::drawEdges(const vector<Contour> &edges, cv::Size size, cv::Mat *out) {
+        cv::Mat edge(size.height, size.width, CV_8UC1, cv::Scalar(0, 0, 0));
+        cv::drawContours(edge, edges, -1, cv::Scalar(255));
         cv::cvtColor(edge, edge, cv::COLOR_GRAY2RGB);
         *out = edge;
+    }
 
-        return *result;
+    /**
+     * Average color of every contour from a single sweep over the image.
+     * Contours are rasterized into one label map in the same largest-area-first
+     * order the svg paints them, so a nested region owns exactly the pixels it
+     * covers in the output and its parent only averages what stays visible.
+     */
+    vector<Pixel> Operations::findContoursAvgColor(const cv::Mat &src, const vector<Contour> &contours) {
+        vector<Pixel> colors;
+        cv::Mat labels;
+        Operations::findContoursAvgColor(src, contours, colors, labels);
+        return colors;
     }
 
-    Pixel Operations::findContourAvgColor(const cv::Mat &src, const Contour &contour) {
-        cv::Mat mask(src.rows, src.cols, CV_8UC1, cv::Scalar(0, 0, 0));
-        auto *edges = new vector<Contour>();
-        edges->push_back(contour);
-        cv::drawContours(mask, *edges, -1, cv::Scalar(255), -1);
-        cv::Scalar color = cv::mean(src, mask = mask);
-        return {float(color[0]), float(color[1]), float(color[2])};
+    void Operations::findContoursAvgColor(const cv::Mat &src, const vector<Contour> &contours,
+                                          vector<Pixel> &colors, cv::Mat &labels) {
+        vector<double> areas(contours.size());
+        vector<int> order(contours.size());
+        iota(order.begin(), order.end(), 0);
+        for (size_t i = 0; i < contours.size(); i++) {
+            areas[i] = cv::contourArea(contours[i]);
+        }
+        stable_sort(order.begin(), order.end(), [&areas](int a, int b) -> bool {
+            return areas[a] > areas[b];
+        });
+
+        labels.create(src.rows, src.cols, CV_32SC1);
+        labels.setTo(cv::Scalar(-1));
+        for (auto index : order) {
+            cv::drawContours(labels, contours, index, cv::Scalar(index), cv::FILLED);
+        }
+
+        const auto channels = src.channels();
+        vector<cv::Vec<uint64_t, 4>> sums(contours.size());
+        for (int row = 0; row < src.rows; row++) {
+            const auto *label = labels.ptr<int>(row);
+            const auto *pixel = src.ptr<uchar>(row);
+            for (int col = 0; col < src.cols; col++, pixel += channels) {
+                if (label[col] < 0) {
+                    continue;
+                }
+                auto &sum = sums[label[col]];
+                sum[0] += pixel[0];
+                sum[1] += pixel[1];
+                sum[2] += pixel[2];
+                sum[3]++;
+            }
+        }
+
+        colors.assign(contours.size(), Pixel());
+        for (size_t i = 0; i < contours.size(); i++) {
+            auto sum = sums[i];
+            if (sum[3] == 0) {
+                // Fully covered by smaller regions, fall back to its own boundary pixels.
+                for (const auto &point : contours[i]) {
+                    const auto *pixel = src.ptr<uchar>(min(max(point.y, 0), src.rows - 1)) +
+                                        min(max(point.x, 0), src.cols - 1) * channels;
+                    sum[0] += pixel[0];
+                    sum[1] += pixel[1];
+                    sum[2] += pixel[2];
+                    sum[3]++;
+                }
+            }
+            if (sum[3] > 0) {
+                colors[i] = Pixel(float(sum[0]) / sum[3], float(sum[1]) / sum[3], float(sum[2]) / sum[3]);
+            }
+        }
     }
-}
\ No newline at end of file
+}
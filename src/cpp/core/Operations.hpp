@@ -8,19 +8,72 @@
 
 #include <opencv2/core/mat.hpp>
 #include <utils/Constants.hpp>
+#include <utils/Profiler.hpp>
 
 namespace pi {
 
+    struct HistogramScratch;
+
+    class ConversionContext;
 
     class Operations {
     public:
-        cv::Mat static kMeanSegmentation(cv::Mat *src, cv::Mat *out, unsigned int k);
+        cv::Mat static kMeanSegmentation(cv::Mat *src, cv::Mat *out, unsigned int k, cv::Mat *labels = nullptr);
+
+        cv::Mat static colorSegmentation(cv::Mat *src, cv::Mat *out, unsigned int k,
+                                         QuantizationEngine engine = QUANTIZATION_ENGINE,
+                                         cv::Mat *labels = nullptr, HistogramScratch *scratch = nullptr);
+
+        /**
+         * Outer boundaries and holes of every label in a CV_8UC1 label map, in label
+         * order. `edgeLabels` receives the label of each returned contour.
+         */
+        std::vector<Contour> static findLabelContours(const cv::Mat &labels, int labelCount,
+                                                      std::vector<int> *edgeLabels = nullptr);
+
+        /**
+         * Same regions as findLabelContours, traced in a single pass over the label
+         * map with BoundaryTracer instead of one findContours sweep per label.
+         */
+        std::vector<Contour> static traceLabelBoundaries(const cv::Mat &labels, std::vector<int> *edgeLabels = nullptr);
 
-        SegmentedEdgeResult static findColorSegmentedEdge(cv::Mat *src, cv::Mat *out, unsigned int k);
+        void static traceLabelBoundaries(const cv::Mat &labels, std::vector<Contour> &edges,
+                                         std::vector<int> *edgeLabels, cv::Mat *visited = nullptr);
+
+        /**
+         * Quantizes `src` and traces the regions of every color. The edges are
+         * drawn into `out` unless it is null. With a `profiler` the two steps are
+         * recorded as the quantize and trace stages.
+         */
+        SegmentedEdgeResult static findColorSegmentedEdge(cv::Mat *src, cv::Mat *out, unsigned int k,
+                                                          QuantizationEngine engine = QUANTIZATION_ENGINE,
+                                                          TracingEngine tracer = TRACING_ENGINE,
+                                                          Profiler *profiler = nullptr);
+
+        /**
+         * Same as above, leaving the result in `context.segments` and keeping
+         * every intermediate buffer in `context`. A non empty `palette` is used
+         * as is instead of quantizing to `k` colors.
+         */
+        void static findColorSegmentedEdge(cv::Mat *src, cv::Mat *out, unsigned int k, QuantizationEngine engine,
+                                           TracingEngine tracer, Profiler *profiler, ConversionContext &context,
+                                           const std::vector<cv::Vec3b> *palette = nullptr);
+
+        /**
+         * Draws `edges` white on black into an RGB image of `size`.
+         */
+        void static drawEdges(const std::vector<Contour> &edges, cv::Size size, cv::Mat *out);
 
         void static sharpen(cv::Mat *src, cv::Mat *out, unsigned int k = 5);
 
-        Pixel static findContourAvgColor(const cv::Mat &src, const Contour &contour);
+        std::vector<Pixel> static findContoursAvgColor(const cv::Mat &src, const std::vector<Contour> &contours);
+
+        /**
+         * Same as above, writing into `colors` and rasterizing the regions into
+         * the caller's `regionLabels`.
+         */
+        void static findContoursAvgColor(const cv::Mat &src, const std::vector<Contour> &contours,
+                                         std::vector<Pixel> &colors, cv::Mat &regionLabels);
     };
 
 }
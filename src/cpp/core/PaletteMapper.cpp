@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <stdexcept>
+#include <opencv2/core.hpp>
+
+#include "PaletteMapper.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AUTOSVG_X86_KERNELS
+
+#include <immintrin.h>
+
+#endif
+
+#if defined(__wasm_simd128__)
+#define AUTOSVG_WASM_SIMD_KERNELS
+
+#include <wasm_simd128.h>
+
+#endif
+
+using namespace std;
+
+namespace pi {
+    /**
+     * Palette split into one int lane per channel, so the SIMD kernels can
+     * broadcast a single entry without any shuffling.
+     */
+    struct PaletteLanes {
+        int size;
+        int c0[MAX_K_COLORS];
+        int c1[MAX_K_COLORS];
+        int c2[MAX_K_COLORS];
+    };
+
+    typedef void (*AssignRowKernel)(const uchar *src, int channels, int width,
+                                    const PaletteLanes &palette, uchar *labels);
+
+    static inline uchar nearestEntry(const uchar *pixel, const PaletteLanes &palette) {
+        int best = INT_MAX;
+        int label = 0;
+        for (int j = 0; j < palette.size; j++) {
+            const int d0 = pixel[0] - palette.c0[j];
+            const int d1 = pixel[1] - palette.c1[j];
+            const int d2 = pixel[2] - palette.c2[j];
+            const int d = d0 * d0 + d1 * d1 + d2 * d2;
+            if (d < best) {
+                best = d;
+                label = j;
+            }
+        }
+        return (uchar) label;
+    }
+
+    static void assignRowScalar(const uchar *src, int channels, int width,
+                                const PaletteLanes &palette, uchar *labels) {
+        for (int x = 0; x < width; x++, src += channels) {
+            labels[x] = nearestEntry(src, palette);
+        }
+    }
+
+#ifdef AUTOSVG_X86_KERNELS
+
+    // Ties resolve to the lowest palette index in every kernel, so all of
+    // them produce byte-identical label maps.
+
+    __attribute__((target("sse4.1")))
+    static void assignRowSse41(const uchar *src, int channels, int width,
+                               const PaletteLanes &palette, uchar *labels) {
+        alignas(16) int c0[4], c1[4], c2[4], result[4];
+        int x = 0;
+        for (; x + 4 <= width; x += 4) {
+            for (int i = 0; i < 4; i++) {
+                const uchar *pixel = src + (x + i) * channels;
+                c0[i] = pixel[0];
+                c1[i] = pixel[1];
+                c2[i] = pixel[2];
+            }
+            const __m128i v0 = _mm_load_si128((const __m128i *) c0);
+            const __m128i v1 = _mm_load_si128((const __m128i *) c1);
+            const __m128i v2 = _mm_load_si128((const __m128i *) c2);
+            __m128i best = _mm_set1_epi32(INT_MAX);
+            __m128i label = _mm_setzero_si128();
+            for (int j = 0; j < palette.size; j++) {
+                const __m128i d0 = _mm_sub_epi32(v0, _mm_set1_epi32(palette.c0[j]));
+                const __m128i d1 = _mm_sub_epi32(v1, _mm_set1_epi32(palette.c1[j]));
+                const __m128i d2 = _mm_sub_epi32(v2, _mm_set1_epi32(palette.c2[j]));
+                const __m128i d = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(d0, d0), _mm_mullo_epi32(d1, d1)),
+                                                _mm_mullo_epi32(d2, d2));
+                const __m128i closer = _mm_cmpgt_epi32(best, d);
+                best = _mm_min_epi32(best, d);
+                label = _mm_blendv_epi8(label, _mm_set1_epi32(j), closer);
+            }
+            _mm_store_si128((__m128i *) result, label);
+            for (int i = 0; i < 4; i++) {
+                labels[x + i] = (uchar) result[i];
+            }
+        }
+        assignRowScalar(src + x * channels, channels, width - x, palette, labels + x);
+    }
+
+    __attribute__((target("avx2")))
+    static void assignRowAvx2(const uchar *src, int channels, int width,
+                              const PaletteLanes &palette, uchar *labels) {
+        alignas(32) int c0[8], c1[8], c2[8], result[8];
+        int x = 0;
+        for (; x + 8 <= width; x += 8) {
+            for (int i = 0; i < 8; i++) {
+                const uchar *pixel = src + (x + i) * channels;
+                c0[i] = pixel[0];
+                c1[i] = pixel[1];
+                c2[i] = pixel[2];
+            }
+            const __m256i v0 = _mm256_load_si256((const __m256i *) c0);
+            const __m256i v1 = _mm256_load_si256((const __m256i *) c1);
+            const __m256i v2 = _mm256_load_si256((const __m256i *) c2);
+            __m256i best = _mm256_set1_epi32(INT_MAX);
+            __m256i label = _mm256_setzero_si256();
+            for (int j = 0; j < palette.size; j++) {
+                const __m256i d0 = _mm256_sub_epi32(v0, _mm256_set1_epi32(palette.c0[j]));
+                const __m256i d1 = _mm256_sub_epi32(v1, _mm256_set1_epi32(palette.c1[j]));
+                const __m256i d2 = _mm256_sub_epi32(v2, _mm256_set1_epi32(palette.c2[j]));
+                const __m256i d = _mm256_add_epi32(
+                        _mm256_add_epi32(_mm256_mullo_epi32(d0, d0), _mm256_mullo_epi32(d1, d1)),
+                        _mm256_mullo_epi32(d2, d2));
+                const __m256i closer = _mm256_cmpgt_epi32(best, d);
+                best = _mm256_min_epi32(best, d);
+                label = _mm256_blendv_epi8(label, _mm256_set1_epi32(j), closer);
+            }
+            _mm256_store_si256((__m256i *) result, label);
+            for (int i = 0; i < 8; i++) {
+                labels[x + i] = (uchar) result[i];
+            }
+        }
+        assignRowScalar(src + x * channels, channels, width - x, palette, labels + x);
+    }
+
+#endif
+
+#ifdef AUTOSVG_WASM_SIMD_KERNELS
+
+    // WebAssembly has no runtime feature detection, this kernel is compiled
+    // in by -msimd128 and always used in that build.
+    static void assignRowSimd128(const uchar *src, int channels, int width,
+                                 const PaletteLanes &palette, uchar *labels) {
+        alignas(16) int result[4];
+        int x = 0;
+        for (; x + 4 <= width; x += 4) {
+            const uchar *p = src + x * channels;
+            const v128_t v0 = wasm_i32x4_make(p[0], p[channels], p[2 * channels], p[3 * channels]);
+            const v128_t v1 = wasm_i32x4_make(p[1], p[channels + 1], p[2 * channels + 1], p[3 * channels + 1]);
+            const v128_t v2 = wasm_i32x4_make(p[2], p[channels + 2], p[2 * channels + 2], p[3 * channels + 2]);
+            v128_t best = wasm_i32x4_splat(INT_MAX);
+            v128_t label = wasm_i32x4_splat(0);
+            for (int j = 0; j < palette.size; j++) {
+                const v128_t d0 = wasm_i32x4_sub(v0, wasm_i32x4_splat(palette.c0[j]));
+                const v128_t d1 = wasm_i32x4_sub(v1, wasm_i32x4_splat(palette.c1[j]));
+                const v128_t d2 = wasm_i32x4_sub(v2, wasm_i32x4_splat(palette.c2[j]));
+                const v128_t d = wasm_i32x4_add(wasm_i32x4_add(wasm_i32x4_mul(d0, d0), wasm_i32x4_mul(d1, d1)),
+                                                wasm_i32x4_mul(d2, d2));
+                const v128_t closer = wasm_i32x4_gt(best, d);
+                best = wasm_i32x4_min(best, d);
+                label = wasm_v128_bitselect(wasm_i32x4_splat(j), label, closer);
+            }
+            wasm_v128_store(result, label);
+            for (int i = 0; i < 4; i++) {
+                labels[x + i] = (uchar) result[i];
+            }
+        }
+        assignRowScalar(src + x * channels, channels, width - x, palette, labels + x);
+    }
+
+#endif
+
+    static AssignRowKernel selectKernel(string *name) {
+#ifdef AUTOSVG_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            *name = "avx2";
+            return assignRowAvx2;
+        }
+        if (__builtin_cpu_supports("sse4.1")) {
+            *name = "sse4.1";
+            return assignRowSse41;
+        }
+#endif
+#ifdef AUTOSVG_WASM_SIMD_KERNELS
+        *name = "simd128";
+        return assignRowSimd128;
+#else
+        *name = "scalar";
+        return assignRowScalar;
+#endif
+    }
+
+    static string kernelName;
+    static const AssignRowKernel assignRow = selectKernel(&kernelName);
+
+    string PaletteMapper::instructionSet() {
+        return kernelName;
+    }
+
+    static PaletteLanes toLanes(const vector<cv::Vec3b> &palette) {
+        CV_Assert(!palette.empty() && palette.size() <= MAX_K_COLORS);
+        PaletteLanes lanes;
+        lanes.size = (int) palette.size();
+        for (int j = 0; j < lanes.size; j++) {
+            lanes.c0[j] = palette[j][0];
+            lanes.c1[j] = palette[j][1];
+            lanes.c2[j] = palette[j][2];
+        }
+        return lanes;
+    }
+
+    void PaletteMapper::assignLabels(const cv::Mat &src, const vector<cv::Vec3b> &palette,
+                                     cv::Mat *labels, cv::Mat *quantized) {
+        CV_Assert(src.depth() == CV_8U && src.channels() >= 3);
+        const PaletteLanes lanes = toLanes(palette);
+
+        labels->create(src.rows, src.cols, CV_8UC1);
+        if (quantized != nullptr) {
+            quantized->create(src.rows, src.cols, CV_8UC3);
+        }
+
+        const auto channels = src.channels();
+        cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range &range) {
+            for (int row = range.start; row < range.end; row++) {
+                auto *label = labels->ptr<uchar>(row);
+                assignRow(src.ptr<uchar>(row), channels, src.cols, lanes, label);
+                if (quantized != nullptr) {
+                    auto *output = quantized->ptr<cv::Vec3b>(row);
+                    for (int col = 0; col < src.cols; col++) {
+                        output[col] = palette[label[col]];
+                    }
+                }
+            }
+        });
+    }
+
+    void PaletteMapper::refineLabels(const cv::Mat &src, const vector<cv::Vec3b> &palette, const cv::Mat &mask,
+                                     cv::Mat *labels) {
+        CV_Assert(src.depth() == CV_8U && src.channels() >= 3);
+        CV_Assert(mask.type() == CV_8UC1 && mask.size() == src.size() && labels->size() == src.size());
+        const PaletteLanes lanes = toLanes(palette);
+
+        // Masked pixels come in runs along the row, each run goes through the kernel at once.
+        const auto channels = src.channels();
+        cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range &range) {
+            for (int row = range.start; row < range.end; row++) {
+                const auto *pixels = src.ptr<uchar>(row);
+                const auto *masked = mask.ptr<uchar>(row);
+                auto *label = labels->ptr<uchar>(row);
+                for (int col = 0; col < src.cols;) {
+                    if (!masked[col]) {
+                        col++;
+                        continue;
+                    }
+                    int end = col + 1;
+                    while (end < src.cols && masked[end]) {
+                        end++;
+                    }
+                    assignRow(pixels + col * channels, channels, end - col, lanes, label + col);
+                    col = end;
+                }
+            }
+        });
+    }
+
+    void PaletteMapper::remapLabels(const cv::Mat &labels, const vector<cv::Vec3b> &palette, cv::Mat *quantized) {
+        CV_Assert(labels.type() == CV_8UC1);
+        quantized->create(labels.rows, labels.cols, CV_8UC3);
+        cv::parallel_for_(cv::Range(0, labels.rows), [&](const cv::Range &range) {
+            for (int row = range.start; row < range.end; row++) {
+                const auto *label = labels.ptr<uchar>(row);
+                auto *output = quantized->ptr<cv::Vec3b>(row);
+                for (int col = 0; col < labels.cols; col++) {
+                    output[col] = palette[label[col]];
+                }
+            }
+        });
+    }
+
+    vector<cv::Vec3b> PaletteMapper::toPalette(const cv::Mat &colors) {
+        vector<cv::Vec3b> palette;
+        for (int i = 0; i < colors.rows; i++) {
+            const auto &color = colors.at<Pixel>(i, 0);
+            palette.emplace_back(cv::saturate_cast<uchar>(color.x),
+                                 cv::saturate_cast<uchar>(color.y),
+                                 cv::saturate_cast<uchar>(color.z));
+        }
+        return palette;
+    }
+
+    cv::Mat PaletteMapper::toColors(const vector<cv::Vec3b> &palette) {
+        cv::Mat colors((int) palette.size(), 1, CV_32FC3);
+        for (size_t j = 0; j < palette.size(); j++) {
+            colors.at<Pixel>((int) j, 0) = Pixel(palette[j][0], palette[j][1], palette[j][2]);
+        }
+        return colors;
+    }
+
+    vector<cv::Vec3b> PaletteMapper::parsePalette(const string &colors) {
+        vector<cv::Vec3b> palette;
+        size_t position = 0;
+        while ((position = colors.find_first_not_of(", \t\r\n", position)) != string::npos) {
+            const size_t end = min(colors.find_first_of(", \t\r\n", position), colors.size());
+            string hex = colors.substr(position, end - position);
+            position = end;
+            if (hex[0] == '#') {
+                hex.erase(0, 1);
+            }
+            if (hex.size() != 6 || !all_of(hex.begin(), hex.end(), [](char c) { return isxdigit(c) != 0; })) {
+                throw invalid_argument("Invalid palette color " + hex);
+            }
+            const auto value = stoul(hex, nullptr, 16);
+            palette.emplace_back(uchar(value >> 16), uchar(value >> 8), uchar(value));
+        }
+        if (palette.empty() || palette.size() > MAX_K_COLORS) {
+            throw invalid_argument("A palette needs 1 to " + to_string(MAX_K_COLORS) + " colors");
+        }
+        return palette;
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef AUTOSVG_WASM_PALETTEMAPPER_HPP
+#define AUTOSVG_WASM_PALETTEMAPPER_HPP
+
+#include <string>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+#include <utils/Constants.hpp>
+
+namespace pi {
+
+    class PaletteMapper {
+    public:
+        /**
+         * Assigns every pixel of an 8 bit, 3 or 4 channel image to its nearest
+         * palette entry. Writes the CV_8UC1 label map and, when `quantized` is
+         * given, the CV_8UC3 image rebuilt from the palette. Rows are split across
+         * cores and each row runs the widest SIMD kernel the cpu supports.
+         */
+        void static assignLabels(const cv::Mat &src, const std::vector<cv::Vec3b> &palette,
+                                 cv::Mat *labels, cv::Mat *quantized = nullptr);
+
+        /**
+         * Same as assignLabels, but only for the pixels where the CV_8UC1 `mask`
+         * is set. The other labels are left as they are.
+         */
+        void static refineLabels(const cv::Mat &src, const std::vector<cv::Vec3b> &palette, const cv::Mat &mask,
+                                 cv::Mat *labels);
+
+        /**
+         * Rebuilds the CV_8UC3 image of a CV_8UC1 label map.
+         */
+        void static remapLabels(const cv::Mat &labels, const std::vector<cv::Vec3b> &palette, cv::Mat *quantized);
+
+        std::vector<cv::Vec3b> static toPalette(const cv::Mat &colors);
+
+        cv::Mat static toColors(const std::vector<cv::Vec3b> &palette);
+
+        /**
+         * Reads a palette of `#rrggbb` or `rrggbb` colors separated by commas or
+         * white space, in the RGB order the pipeline traces. Throws
+         * std::invalid_argument for anything else or more than MAX_K_COLORS.
+         */
+        std::vector<cv::Vec3b> static parsePalette(const std::string &colors);
+
+        /**
+         * Name of the kernel picked at runtime: "avx2", "sse4.1", "simd128" or "scalar".
+         */
+        std::string static instructionSet();
+    };
+}
+
+#endif //AUTOSVG_WASM_PALETTEMAPPER_HPP
@@ -0,0 +1,101 @@
+#include <cmath>
+#include <stdexcept>
+#include <opencv2/opencv.hpp>
+
+#include "PyramidConversion.hpp"
+#include "BoundaryTracer.hpp"
+#include "ColorQuantizer.hpp"
+#include "PaletteMapper.hpp"
+#include <utils/CurveUtils.hpp>
+
+using namespace std;
+
+namespace pi {
+    void PyramidConversion::convertToCurves(const cv::Mat &image, const ConversionOptions &options,
+                                            ConversionContext &context) {
+        if (options.tracer != BOUNDARY_TRACING) {
+            throw invalid_argument("Pyramid conversion only supports the boundaries tracer");
+        }
+        if (options.quantizer != HISTOGRAM_QUANTIZATION && options.palette.empty() &&
+            options.colors != AUTO_K_COLORS) {
+            throw invalid_argument("Pyramid conversion only supports the histogram quantizer or a fixed palette");
+        }
+
+        Profiler *profiler = options.profiler;
+        SegmentedEdgeResult &segments = context.segments;
+        const double scale = options.width > 0 && image.cols > options.width ? image.cols / double(options.width) : 1;
+
+        vector<cv::Vec3b> palette;
+        cv::Mat coarse = image;
+        {
+            ProfileScope quantize(profiler, "quantize");
+            if (scale > 1) {
+                const cv::Size size(options.width, max(1, int(lround(image.rows / scale))));
+                cv::resize(image, context.resized, size, 0, 0, cv::INTER_AREA);
+                coarse = context.resized;
+            }
+            if (options.palette.empty()) {
+                ColorQuantizer::buildHistogram(coarse, context.histogram);
+                palette = ColorQuantizer::histogramPalette(context.histogram.histogram, options.colors);
+            } else {
+                palette = options.palette;
+            }
+            // Images no wider than the coarse level are labeled at full resolution right away.
+            PaletteMapper::assignLabels(coarse, palette, scale > 1 ? &context.coarseLabels : &segments.labels);
+            quantize.items(coarse.total());
+        }
+
+        if (scale > 1) {
+            ProfileScope refine(profiler, "refine");
+            PyramidConversion::labelBand(context.coarseLabels, PYRAMID_BAND_CELLS, &context.coarseBand);
+            cv::resize(context.coarseLabels, segments.labels, image.size(), 0, 0, cv::INTER_NEAREST);
+            cv::resize(context.coarseBand, context.band, image.size(), 0, 0, cv::INTER_NEAREST);
+            PaletteMapper::refineLabels(image, palette, context.band, &segments.labels);
+            refine.items(image.total());
+        }
+
+        vector<Pixel> &colors = context.colors;
+        {
+            ProfileScope trace(profiler, "trace");
+            BoundaryTracer::trace(segments.labels, MINIMUM_CONTOUR_AREA * scale * scale,
+                                  image.total() * MAXIMUM_CONTOUR_TO_IMAGE_RATIO, &segments.edges,
+                                  &segments.edgeLabels, &context.visited);
+            colors.clear();
+            for (size_t i = 0; i < segments.edges.size(); i++) {
+                const auto label = BoundaryTracer::insideLabel(segments.labels, segments.edges[i],
+                                                               segments.edgeLabels[i]);
+                colors.emplace_back(palette[label][0], palette[label][1], palette[label][2]);
+            }
+            trace.items(segments.edges.size());
+        }
+
+        ProfileScope fit(profiler, "fit");
+        CurveUtils::convertContoursToBezierCurves(segments.edges, options.sharpness, colors, options.fitting,
+                                                  context.curves, context.fitters);
+        fit.items(segments.edges.size());
+    }
+
+    void PyramidConversion::labelBand(const cv::Mat &labels, int radius, cv::Mat *band) {
+        CV_Assert(labels.type() == CV_8UC1);
+        band->create(labels.rows, labels.cols, CV_8UC1);
+        cv::parallel_for_(cv::Range(0, labels.rows), [&](const cv::Range &range) {
+            for (int y = range.start; y < range.end; y++) {
+                const auto *label = labels.ptr<uchar>(y);
+                auto *marked = band->ptr<uchar>(y);
+                for (int x = 0; x < labels.cols; x++) {
+                    uchar differs = 0;
+                    for (int ny = max(0, y - radius); ny <= min(labels.rows - 1, y + radius) && !differs; ny++) {
+                        const auto *neighbours = labels.ptr<uchar>(ny);
+                        for (int nx = max(0, x - radius); nx <= min(labels.cols - 1, x + radius); nx++) {
+                            if (neighbours[nx] != label[x]) {
+                                differs = 1;
+                                break;
+                            }
+                        }
+                    }
+                    marked[x] = differs;
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef AUTOSVG_WASM_PYRAMIDCONVERSION_HPP
+#define AUTOSVG_WASM_PYRAMIDCONVERSION_HPP
+
+#include <opencv2/core/mat.hpp>
+#include "AutosvgConverter.hpp"
+#include "ConversionContext.hpp"
+
+namespace pi {
+
+    /**
+     * Coarse to fine conversion.
+     *
+     * The palette and the regions come from the image downscaled to
+     * `options.width`. Their label map is upscaled and only the pixels within
+     * PYRAMID_BAND_CELLS coarse cells of a label change are labeled again from
+     * the full resolution pixels, so boundaries land where the original image
+     * puts them while flat areas cost no more than at the coarse level.
+     * Boundaries are traced and fitted in original pixel coordinates, and
+     * regions smaller than MINIMUM_CONTOUR_AREA coarse pixels are dropped like
+     * in the resized conversion. It needs the histogram quantizer or a fixed
+     * palette and the boundary tracer, other settings and edge previews are
+     * rejected with std::invalid_argument.
+     */
+    class PyramidConversion {
+    public:
+        /**
+         * Fits the curves of the RGB `image` into `context.curves`.
+         */
+        void static convertToCurves(const cv::Mat &image, const ConversionOptions &options,
+                                    ConversionContext &context);
+
+        /**
+         * Marks the cells of a CV_8UC1 label map that have a different label
+         * within `radius` cells.
+         */
+        void static labelBand(const cv::Mat &labels, int radius, cv::Mat *band);
+    };
+}
+
+#endif //AUTOSVG_WASM_PYRAMIDCONVERSION_HPP
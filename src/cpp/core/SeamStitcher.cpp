@@ -0,0 +1,150 @@
+#include <opencv2/core.hpp>
+
+#include "SeamStitcher.hpp"
+#include "BoundaryTracer.hpp"
+
+using namespace std;
+
+namespace pi {
+    static inline uint64_t endpointKey(int label, const cv::Point &point) {
+        return (uint64_t(label) << 56) | (uint64_t(uint32_t(point.x)) << 28) | uint64_t(uint32_t(point.y));
+    }
+
+    void SeamStitcher::addTile(const cv::Mat &labels, const cv::Rect &area, const cv::Rect &tile,
+                               const vector<Contour> &contours, const vector<int> &contourLabels,
+                               vector<Contour> &closed, vector<int> &closedLabels) {
+        const cv::Point offset = tile.tl();
+        vector<char> seam;
+        vector<int> inside;
+
+        for (size_t c = 0; c < contours.size(); c++) {
+            const Contour &contour = contours[c];
+            const int label = contourLabels[c];
+            const size_t size = contour.size();
+
+            // Classify every edge: a seam edge has a pixel of its own label on
+            // the other side of the tile border.
+            seam.assign(size, 0);
+            inside.assign(size, -1);
+            bool cut = false;
+            for (size_t i = 0; i < size; i++) {
+                const cv::Point left = BoundaryTracer::leftPixel(contour[i], contour[(i + 1) % size]) + offset;
+                if (!area.contains(left)) {
+                    continue;
+                }
+                inside[i] = labels.at<uchar>(left.y - area.y, left.x - area.x);
+                if (!tile.contains(left) && inside[i] == label) {
+                    seam[i] = 1;
+                    cut = true;
+                }
+            }
+
+            if (!cut) {
+                Contour points(contour.size());
+                for (size_t i = 0; i < size; i++) {
+                    points[i] = contour[i] + offset;
+                }
+                closedLabels.push_back(BoundaryTracer::signedArea(points) > 0 ? label : inside[0]);
+                closed.push_back(std::move(points));
+                continue;
+            }
+
+            // Every run of real edges between two seam edges becomes a chain.
+            size_t first = 0;
+            while (!seam[first]) {
+                first++;
+            }
+            Chain chain;
+            chain.label = label;
+            for (size_t step = 1; step <= size; step++) {
+                const size_t i = (first + step) % size;
+                if (seam[i]) {
+                    if (!chain.points.empty()) {
+                        chain.points.push_back(contour[i] + offset);
+                        attach(std::move(chain), closed, closedLabels);
+                        chain = Chain();
+                        chain.label = label;
+                    }
+                    continue;
+                }
+                if (chain.points.empty()) {
+                    chain.inside = inside[i];
+                }
+                chain.points.push_back(contour[i] + offset);
+            }
+        }
+    }
+
+    void SeamStitcher::attach(Chain &&chain, vector<Contour> &closed, vector<int> &closedLabels) {
+        size_t id;
+        if (freeChains.empty()) {
+            id = chains.size();
+            chains.push_back(std::move(chain));
+        } else {
+            id = freeChains.back();
+            freeChains.pop_back();
+            chains[id] = std::move(chain);
+        }
+
+        // The chain is kept out of the indexes until it stops growing.
+        while (true) {
+            Chain &current = chains[id];
+            if (current.points.size() > 1 && current.points.front() == current.points.back()) {
+                current.points.pop_back();
+                closedLabels.push_back(BoundaryTracer::signedArea(current.points) > 0 ? current.label : current.inside);
+                closed.push_back(std::move(current.points));
+                chains[id] = Chain();
+                freeChains.push_back(id);
+                return;
+            }
+
+            size_t other;
+            if (take(starts, endpointKey(current.label, current.points.back()), &other)) {
+                // Continues with `other`.
+                Chain &next = chains[other];
+                drop(ends, endpointKey(next.label, next.points.back()), other);
+                openPointCount -= next.points.size();
+                current.points.insert(current.points.end(), next.points.begin() + 1, next.points.end());
+                next = Chain();
+                freeChains.push_back(other);
+                continue;
+            }
+            if (take(ends, endpointKey(current.label, current.points.front()), &other)) {
+                // Continues `other`, which keeps its first edge and so its inside label.
+                Chain &previous = chains[other];
+                drop(starts, endpointKey(previous.label, previous.points.front()), other);
+                openPointCount -= previous.points.size();
+                previous.points.insert(previous.points.end(), current.points.begin() + 1, current.points.end());
+                current = Chain();
+                freeChains.push_back(id);
+                id = other;
+                continue;
+            }
+
+            starts.emplace(endpointKey(current.label, current.points.front()), id);
+            ends.emplace(endpointKey(current.label, current.points.back()), id);
+            openPointCount += current.points.size();
+            return;
+        }
+    }
+
+    bool SeamStitcher::take(unordered_multimap<uint64_t, size_t> &index, uint64_t key, size_t *chain) {
+        auto found = index.find(key);
+        if (found == index.end()) {
+            return false;
+        }
+        *chain = found->second;
+        index.erase(found);
+        return true;
+    }
+
+    void SeamStitcher::drop(unordered_multimap<uint64_t, size_t> &index, uint64_t key, size_t chain) {
+        auto range = index.equal_range(key);
+        for (auto entry = range.first; entry != range.second; ++entry) {
+            if (entry->second == chain) {
+                index.erase(entry);
+                return;
+            }
+        }
+    }
+}
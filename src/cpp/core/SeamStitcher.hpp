@@ -0,0 +1,76 @@
+#ifndef AUTOSVG_WASM_SEAMSTITCHER_HPP
+#define AUTOSVG_WASM_SEAMSTITCHER_HPP
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+#include <utils/Constants.hpp>
+
+namespace pi {
+
+    /**
+     * Joins the BoundaryTracer boundaries of separately traced tiles into the
+     * boundaries of the whole image.
+     *
+     * A region cut by a tile edge gets a boundary along that edge in each tile,
+     * although the pixels on both sides share its label. Those seam edges are
+     * dropped, which leaves open chains ending on the seams. Because every
+     * boundary keeps its region on the right, a chain ending at a point always
+     * continues with a chain of the same label starting there, so chains are
+     * joined by their end points until they close.
+     */
+    class SeamStitcher {
+    public:
+        /**
+         * Adds the boundaries traced inside `tile`, in image coordinates.
+         * `labels` is the label map of `area`, which is `tile` grown by one pixel
+         * on each side where the image allows. Boundaries closed by this tile
+         * are appended to `closed`, with the label their inside is painted
+         * with: the region's own label for outer boundaries, the label of the
+         * enclosed pixels for holes.
+         */
+        void addTile(const cv::Mat &labels, const cv::Rect &area, const cv::Rect &tile,
+                     const std::vector<Contour> &contours, const std::vector<int> &contourLabels,
+                     std::vector<Contour> &closed, std::vector<int> &closedLabels);
+
+        /**
+         * Boundaries still waiting for a neighbouring tile.
+         */
+        size_t openChains() const {
+            return starts.size();
+        }
+
+        /**
+         * Points held by the open chains.
+         */
+        size_t openPoints() const {
+            return openPointCount;
+        }
+
+    private:
+        struct Chain {
+            Contour points;
+            int label;
+            /**
+             * Label of the pixel on the left of the first edge, inside the
+             * boundary once it closes.
+             */
+            int inside;
+        };
+
+        std::vector<Chain> chains;
+        std::vector<size_t> freeChains;
+        std::unordered_multimap<uint64_t, size_t> starts;
+        std::unordered_multimap<uint64_t, size_t> ends;
+        size_t openPointCount = 0;
+
+        void attach(Chain &&chain, std::vector<Contour> &closed, std::vector<int> &closedLabels);
+
+        bool take(std::unordered_multimap<uint64_t, size_t> &index, uint64_t key, size_t *chain);
+
+        void drop(std::unordered_multimap<uint64_t, size_t> &index, uint64_t key, size_t chain);
+    };
+}
+
+#endif //AUTOSVG_WASM_SEAMSTITCHER_HPP
@@ -0,0 +1,152 @@
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <opencv2/opencv.hpp>
+
+#include "TiledConversion.hpp"
+#include "BoundaryTracer.hpp"
+#include "ColorQuantizer.hpp"
+#include "PaletteMapper.hpp"
+#include "SeamStitcher.hpp"
+#include <utils/CurveUtils.hpp>
+
+using namespace std;
+
+namespace pi {
+    /**
+     * Pixels of `area` with RGB in their first three channels. RGB and RGBA
+     * images are used in place, BGR ones are converted into `buffer`.
+     */
+    static cv::Mat rgbPixels(const cv::Mat &image, const cv::Rect &area, PixelFormat format, cv::Mat &buffer) {
+        const cv::Mat pixels = image(area);
+        if (format == RGB_FORMAT || format == RGBA_FORMAT) {
+            return pixels;
+        }
+        cv::cvtColor(pixels, buffer, format == BGRA_FORMAT ? cv::COLOR_BGRA2RGB : cv::COLOR_BGR2RGB);
+        return buffer;
+    }
+
+    /**
+     * Bytes a fitted curve keeps, apart from the Curve itself.
+     */
+    static size_t curveBytes(const Curve &curve) {
+        size_t bytes = curve.segments.capacity() * sizeof(CurveSegment);
+        for (const auto &segment : curve.segments) {
+            bytes += segment.capacity() * sizeof(cv::Point2f);
+        }
+        return bytes;
+    }
+
+    void TiledConversion::traceTile(const cv::Mat &image, PixelFormat format, const vector<cv::Vec3b> &palette,
+                                    const cv::Rect &tile, ConversionContext &context, SeamStitcher &stitcher,
+                                    vector<Contour> &closed, vector<int> &closedLabels) {
+        SegmentedEdgeResult &segments = context.segments;
+        // One pixel of margin shows whether a region continues across the tile edge.
+        const cv::Rect area = cv::Rect(tile.x - 1, tile.y - 1, tile.width + 2, tile.height + 2) &
+                              cv::Rect(0, 0, image.cols, image.rows);
+        PaletteMapper::assignLabels(rgbPixels(image, area, format, context.rgb), palette, &segments.labels);
+        const cv::Mat core = segments.labels(cv::Rect(tile.x - area.x, tile.y - area.y, tile.width, tile.height));
+        BoundaryTracer::trace(core, -1, numeric_limits<double>::max(), &segments.edges, &segments.edgeLabels,
+                              &context.visited);
+
+        closed.clear();
+        closedLabels.clear();
+        stitcher.addTile(segments.labels, area, tile, segments.edges, segments.edgeLabels, closed, closedLabels);
+    }
+
+    void TiledConversion::convertToCurves(const cv::Mat &image, PixelFormat format, const ConversionOptions &options,
+                                          ConversionContext &context) {
+        if (options.tracer != BOUNDARY_TRACING) {
+            throw invalid_argument("Tiled conversion only supports the boundaries tracer");
+        }
+        if (options.quantizer != HISTOGRAM_QUANTIZATION && options.palette.empty() &&
+            options.colors != AUTO_K_COLORS) {
+            throw invalid_argument("Tiled conversion only supports the histogram quantizer or a fixed palette");
+        }
+
+        Profiler *profiler = options.profiler;
+        const int tileSize = max(options.tileSize, 1);
+        const cv::Rect bounds(0, 0, image.cols, image.rows);
+
+        vector<cv::Vec3b> palette = options.palette;
+        if (palette.empty()) {
+            ProfileScope quantize(profiler, "quantize");
+            ColorQuantizer::clearHistogram(context.histogram);
+            for (int y = 0; y < image.rows; y += tileSize) {
+                for (int x = 0; x < image.cols; x += tileSize) {
+                    const cv::Rect tile = cv::Rect(x, y, tileSize, tileSize) & bounds;
+                    ColorQuantizer::accumulateHistogram(rgbPixels(image, tile, format, context.rgb), context.histogram);
+                }
+            }
+            ColorQuantizer::collectHistogram(context.histogram);
+            palette = ColorQuantizer::histogramPalette(context.histogram.histogram, options.colors);
+            quantize.items(image.total());
+        }
+
+        const double maxArea = double(image.total()) * MAXIMUM_CONTOUR_TO_IMAGE_RATIO;
+        // What the budget always holds, the open chains and fitted curves come on top.
+        const size_t fixedBytes = image.total() * image.elemSize() +
+                                  size_t(tileSize) * tileSize * TILE_BYTES_PER_PIXEL;
+        size_t fittedBytes = 0;
+        SeamStitcher stitcher;
+        vector<Contour> closed, kept;
+        vector<int> closedLabels;
+        vector<Pixel> colors;
+        vector<Curve> tileCurves;
+        context.curves.clear();
+
+        for (int y = 0; y < image.rows; y += tileSize) {
+            for (int x = 0; x < image.cols; x += tileSize) {
+                const cv::Rect tile = cv::Rect(x, y, tileSize, tileSize) & bounds;
+                {
+                    ProfileScope trace(profiler, "trace");
+                    TiledConversion::traceTile(image, format, palette, tile, context, stitcher, closed, closedLabels);
+                    trace.items(tile.area());
+                }
+
+                ProfileScope fit(profiler, "fit");
+                kept.clear();
+                colors.clear();
+                for (size_t i = 0; i < closed.size(); i++) {
+                    const auto area = cv::contourArea(closed[i]);
+                    if (area > MINIMUM_CONTOUR_AREA && area < maxArea) {
+                        const cv::Vec3b &color = palette[closedLabels[i]];
+                        colors.emplace_back(color[0], color[1], color[2]);
+                        kept.push_back(std::move(closed[i]));
+                    }
+                }
+                CurveUtils::convertContoursToBezierCurves(kept, options.sharpness, colors, options.fitting,
+                                                          tileCurves, context.fitters);
+                for (auto &curve : tileCurves) {
+                    fittedBytes += curveBytes(curve);
+                    context.curves.push_back(std::move(curve));
+                }
+                fit.items(kept.size());
+
+                const size_t held = fixedBytes + fittedBytes + context.curves.capacity() * sizeof(Curve) +
+                                    stitcher.openPoints() * sizeof(cv::Point);
+                if (options.memoryBudget > 0 && held > options.memoryBudget) {
+                    throw runtime_error("Tiled conversion needs more than the memory budget of " +
+                                        to_string(options.memoryBudget >> 20) + "MB for its " +
+                                        to_string(context.curves.size()) + " paths, allow more or use fewer colors");
+                }
+            }
+        }
+        if (stitcher.openChains() != 0) {
+            throw logic_error("Tiled conversion left " + to_string(stitcher.openChains()) +
+                              " boundaries open at the tile seams");
+        }
+    }
+
+    int TiledConversion::tileSizeForBudget(size_t budget, int rows, int cols, int channels) {
+        const double decoded = double(rows) * cols * channels;
+        // Half of what the image leaves, the other half holds the open chains and fitted curves.
+        const double perTile = (double(budget) - decoded) / 2;
+        if (perTile < double(MIN_TILE_SIZE) * MIN_TILE_SIZE * TILE_BYTES_PER_PIXEL) {
+            throw invalid_argument("A memory budget of " + to_string(budget >> 20) + "MB cannot hold a " +
+                                   to_string(cols) + "x" + to_string(rows) + " image");
+        }
+        const int side = int(sqrt(perTile / TILE_BYTES_PER_PIXEL));
+        return max(MIN_TILE_SIZE, min(side, max(rows, cols)));
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef AUTOSVG_WASM_TILEDCONVERSION_HPP
+#define AUTOSVG_WASM_TILEDCONVERSION_HPP
+
+#include <opencv2/core/mat.hpp>
+#include "AutosvgConverter.hpp"
+#include "ConversionContext.hpp"
+#include "SeamStitcher.hpp"
+
+namespace pi {
+
+    /**
+     * Converts images too large to trace at once, one tile at a time.
+     *
+     * A first pass over the tiles builds one histogram and so one palette for
+     * the whole image. The second pass labels each tile with one pixel of
+     * margin, traces it and hands its boundaries to a SeamStitcher, so regions
+     * crossing tile edges still become single paths. Boundaries are fitted as
+     * soon as they close, only those touching unfinished tiles stay as points.
+     *
+     * Memory is the image itself, the working set of one tile, the boundaries
+     * still open at the seams and the fitted curves, which are all kept until
+     * the svg is written. With `options.memoryBudget` their estimate is checked
+     * after every tile and the conversion fails once it is exceeded. Tiles
+     * need the histogram quantizer or a fixed palette and the boundary
+     * tracer, other settings and edge previews are rejected. Paths take their
+     * palette color.
+     */
+    class TiledConversion {
+    public:
+        /**
+         * Fits the curves of `image` into `context.curves`. Throws
+         * std::invalid_argument for unsupported options and std::runtime_error
+         * when the memory budget is exceeded.
+         */
+        void static convertToCurves(const cv::Mat &image, PixelFormat format, const ConversionOptions &options,
+                                    ConversionContext &context);
+
+        /**
+         * Labels and traces one tile of `image` and hands its boundaries to
+         * `stitcher`. Replaces `closed` with the boundaries the tile closed and
+         * `closedLabels` with the labels they are painted with.
+         */
+        void static traceTile(const cv::Mat &image, PixelFormat format, const std::vector<cv::Vec3b> &palette,
+                              const cv::Rect &tile, ConversionContext &context, SeamStitcher &stitcher,
+                              std::vector<Contour> &closed, std::vector<int> &closedLabels);
+
+        /**
+         * Largest tile side whose working set takes at most half of what the
+         * decoded image leaves of `budget` bytes, the rest is kept for the open
+         * boundaries and fitted curves. Throws if not even MIN_TILE_SIZE fits.
+         */
+        int static tileSizeForBudget(size_t budget, int rows, int cols, int channels);
+    };
+}
+
+#endif //AUTOSVG_WASM_TILEDCONVERSION_HPP
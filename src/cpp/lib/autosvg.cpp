@@ -0,0 +1,172 @@
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "autosvg.h"
+#include <core/AutosvgConverter.hpp>
+
+using namespace std;
+
+struct autosvg_converter {
+    pi::AutosvgConverter converter;
+};
+
+static thread_local string lastError;
+
+namespace {
+    struct WriteFailed : runtime_error {
+        WriteFailed() : runtime_error("The write callback failed") {}
+    };
+
+    class CallbackSink : public pi::SvgSink {
+    private:
+        autosvg_write_callback callback;
+        void *userData;
+    public:
+        CallbackSink(autosvg_write_callback callback, void *userData) : callback(callback), userData(userData) {}
+
+        void write(const char *data, size_t size) override {
+            if (callback(userData, data, size) != 0) {
+                throw WriteFailed();
+            }
+        }
+    };
+}
+
+static autosvg_status fail(autosvg_status status, const char *message) {
+    lastError = message;
+    return status;
+}
+
+template<typename Conversion>
+static autosvg_status guarded(const Conversion &conversion) {
+    lastError.clear();
+    try {
+        conversion();
+        return AUTOSVG_OK;
+    } catch (const WriteFailed &e) {
+        return fail(AUTOSVG_WRITE_FAILED, e.what());
+    } catch (const invalid_argument &e) {
+        return fail(AUTOSVG_INVALID_ARGUMENT, e.what());
+    } catch (const exception &e) {
+        return fail(AUTOSVG_ERROR, e.what());
+    } catch (...) {
+        return fail(AUTOSVG_ERROR, "Unknown error");
+    }
+}
+
+void autosvg_default_options(autosvg_options *options) {
+    if (!options) {
+        return;
+    }
+    const pi::ConversionOptions defaults;
+    options->colors = defaults.colors;
+    options->sharpness = defaults.sharpness;
+    options->width = defaults.width;
+    options->quantizer = (autosvg_quantizer) defaults.quantizer;
+    options->tracer = (autosvg_tracer) defaults.tracer;
+    options->fitting = (autosvg_fitting) defaults.fitting;
+    options->precision = defaults.pathData.precision;
+    options->relative = defaults.pathData.relative ? 1 : 0;
+}
+
+autosvg_converter *autosvg_converter_create(const autosvg_options *options) {
+    autosvg_options values;
+    autosvg_default_options(&values);
+    if (options) {
+        values = *options;
+    }
+    if (values.colors < 0 || values.colors > MAX_K_COLORS || values.sharpness < 0 || values.width < 0 ||
+        values.precision < 0 || values.precision > PATH_DATA_MAX_PRECISION ||
+        (values.quantizer != AUTOSVG_QUANTIZER_KMEANS && values.quantizer != AUTOSVG_QUANTIZER_HISTOGRAM) ||
+        (values.tracer != AUTOSVG_TRACER_CONTOURS && values.tracer != AUTOSVG_TRACER_BOUNDARIES) ||
+        (values.fitting != AUTOSVG_FITTING_SIMPLIFIED && values.fitting != AUTOSVG_FITTING_ADAPTIVE)) {
+        fail(AUTOSVG_INVALID_ARGUMENT, "Invalid converter options");
+        return nullptr;
+    }
+
+    pi::ConversionOptions conversion;
+    conversion.colors = values.colors;
+    conversion.sharpness = values.sharpness;
+    conversion.width = values.width;
+    conversion.quantizer = values.quantizer == AUTOSVG_QUANTIZER_KMEANS ? KMEANS_QUANTIZATION
+                                                                         : HISTOGRAM_QUANTIZATION;
+    conversion.tracer = values.tracer == AUTOSVG_TRACER_CONTOURS ? CONTOUR_TRACING : BOUNDARY_TRACING;
+    conversion.fitting = values.fitting == AUTOSVG_FITTING_SIMPLIFIED ? SIMPLIFIED_FITTING : ADAPTIVE_FITTING;
+    conversion.pathData.precision = values.precision;
+    conversion.pathData.relative = values.relative != 0;
+
+    auto converter = new(nothrow) autosvg_converter{pi::AutosvgConverter(conversion)};
+    if (!converter) {
+        fail(AUTOSVG_ERROR, "Out of memory");
+    }
+    return converter;
+}
+
+void autosvg_converter_destroy(autosvg_converter *converter) {
+    delete converter;
+}
+
+autosvg_status autosvg_converter_set_palette(autosvg_converter *converter, const unsigned char *rgb, size_t count) {
+    if (!converter || (count > 0 && !rgb) || count > MAX_K_COLORS) {
+        return fail(AUTOSVG_INVALID_ARGUMENT, "Missing converter or colors, or too many colors");
+    }
+    return guarded([&]() {
+        vector<cv::Vec3b> &palette = converter->converter.options.palette;
+        palette.clear();
+        for (size_t i = 0; i < count; i++, rgb += 3) {
+            palette.emplace_back(rgb[0], rgb[1], rgb[2]);
+        }
+    });
+}
+
+static bool validFormat(autosvg_pixel_format format) {
+    return format == AUTOSVG_RGB || format == AUTOSVG_RGBA || format == AUTOSVG_BGR || format == AUTOSVG_BGRA;
+}
+
+autosvg_status autosvg_convert(const autosvg_converter *converter, const unsigned char *pixels, int width,
+                               int height, size_t stride, autosvg_pixel_format format,
+                               autosvg_write_callback write, void *user_data) {
+    if (!converter || !write || !validFormat(format)) {
+        return fail(AUTOSVG_INVALID_ARGUMENT, "Missing converter, callback or pixel format");
+    }
+    return guarded([&]() {
+        CallbackSink sink(write, user_data);
+        converter->converter.convert(pixels, width, height, stride, (pi::PixelFormat) format, sink);
+    });
+}
+
+autosvg_status autosvg_convert_to_buffer(const autosvg_converter *converter, const unsigned char *pixels,
+                                         int width, int height, size_t stride, autosvg_pixel_format format,
+                                         char **svg, size_t *size) {
+    if (!converter || !svg || !validFormat(format)) {
+        return fail(AUTOSVG_INVALID_ARGUMENT, "Missing converter, output or pixel format");
+    }
+    *svg = nullptr;
+    return guarded([&]() {
+        pi::BufferSink sink;
+        converter->converter.convert(pixels, width, height, stride, (pi::PixelFormat) format, sink);
+
+        auto buffer = static_cast<char *>(malloc(sink.buffer.size() + 1));
+        if (!buffer) {
+            throw bad_alloc();
+        }
+        memcpy(buffer, sink.buffer.data(), sink.buffer.size());
+        buffer[sink.buffer.size()] = '\0';
+        *svg = buffer;
+        if (size) {
+            *size = sink.buffer.size();
+        }
+    });
+}
+
+void autosvg_free(void *buffer) {
+    free(buffer);
+}
+
+const char *autosvg_last_error(void) {
+    return lastError.c_str();
+}
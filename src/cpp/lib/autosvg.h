@@ -0,0 +1,106 @@
+/*
+ * Plain C interface of libautosvg. A converter may be used from several
+ * threads at once; the error message of a call is kept per thread.
+ */
+
+#ifndef AUTOSVG_LIB_AUTOSVG_H
+#define AUTOSVG_LIB_AUTOSVG_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct autosvg_converter autosvg_converter;
+
+typedef enum {
+    AUTOSVG_OK = 0,
+    AUTOSVG_INVALID_ARGUMENT = 1,
+    AUTOSVG_WRITE_FAILED = 2,
+    AUTOSVG_ERROR = 3
+} autosvg_status;
+
+typedef enum {
+    AUTOSVG_RGB = 0,
+    AUTOSVG_RGBA = 1,
+    AUTOSVG_BGR = 2,
+    AUTOSVG_BGRA = 3
+} autosvg_pixel_format;
+
+typedef enum {
+    AUTOSVG_QUANTIZER_KMEANS = 0,
+    AUTOSVG_QUANTIZER_HISTOGRAM = 1
+} autosvg_quantizer;
+
+typedef enum {
+    AUTOSVG_TRACER_CONTOURS = 0,
+    AUTOSVG_TRACER_BOUNDARIES = 1
+} autosvg_tracer;
+
+typedef enum {
+    AUTOSVG_FITTING_SIMPLIFIED = 0,
+    AUTOSVG_FITTING_ADAPTIVE = 1
+} autosvg_fitting;
+
+typedef struct {
+    /* Number of colors, 0 picks it per image. */
+    int colors;
+    int sharpness;
+    /* Working width the image is resized to, 0 keeps its size. */
+    int width;
+    autosvg_quantizer quantizer;
+    autosvg_tracer tracer;
+    autosvg_fitting fitting;
+    /* Decimal places of path coordinates. */
+    int precision;
+    /* Non zero for relative path commands. */
+    int relative;
+} autosvg_options;
+
+/*
+ * Receives the svg in chunks. Returns 0 on success, anything else aborts the
+ * conversion with AUTOSVG_WRITE_FAILED.
+ */
+typedef int (*autosvg_write_callback)(void *user_data, const char *data, size_t size);
+
+void autosvg_default_options(autosvg_options *options);
+
+/* Returns NULL when options are invalid. Passing NULL uses the defaults. */
+autosvg_converter *autosvg_converter_create(const autosvg_options *options);
+
+void autosvg_converter_destroy(autosvg_converter *converter);
+
+/*
+ * Maps pixels straight to `count` fixed colors, given as RGB byte triples,
+ * instead of quantizing to `colors`. A count of 0 quantizes again. Must not
+ * be called while the converter is converting.
+ */
+autosvg_status autosvg_converter_set_palette(autosvg_converter *converter, const unsigned char *rgb, size_t count);
+
+/*
+ * Converts `height` rows of `width` pixels starting at `pixels`. `stride` is
+ * the row size in bytes, 0 for tightly packed rows.
+ */
+autosvg_status autosvg_convert(const autosvg_converter *converter, const unsigned char *pixels, int width,
+                               int height, size_t stride, autosvg_pixel_format format,
+                               autosvg_write_callback write, void *user_data);
+
+/*
+ * Same as autosvg_convert, the document is returned in a buffer allocated
+ * with malloc that the caller releases with autosvg_free.
+ */
+autosvg_status autosvg_convert_to_buffer(const autosvg_converter *converter, const unsigned char *pixels,
+                                         int width, int height, size_t stride, autosvg_pixel_format format,
+                                         char **svg, size_t *size);
+
+void autosvg_free(void *buffer);
+
+/* Message of the last failed call on this thread, empty when there is none. */
+const char *autosvg_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AUTOSVG_LIB_AUTOSVG_H */
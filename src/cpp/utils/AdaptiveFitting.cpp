@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <cmath>
+
+#include "AdaptiveFitting.hpp"
+
+using namespace std;
+
+namespace pi {
+    static inline cv::Point2d normalize(const cv::Point2d &v) {
+        const double length = sqrt(v.dot(v));
+        return length > 0 ? v * (1 / length) : v;
+    }
+
+    static inline cv::Point2d bezierPoint(const cv::Point2d *bezier, double t) {
+        const double s = 1 - t;
+        return bezier[0] * (s * s * s) + bezier[1] * (3 * t * s * s) + bezier[2] * (3 * t * t * s) +
+               bezier[3] * (t * t * t);
+    }
+
+    /**
+     * Fits runs of one contour. Indices are unwrapped, a run may continue past
+     * the end of the contour, and the parameter buffer is reused across fits.
+     */
+    class CubicFitter {
+    private:
+        const Contour &contour;
+        const ptrdiff_t size;
+        const double tolerance;
+        vector<double> &parameters;
+        vector<FittedPiece> &pending;
+
+        cv::Point2d point(ptrdiff_t i) const {
+            const cv::Point &p = contour[((i % size) + size) % size];
+            return cv::Point2d(p.x, p.y);
+        }
+
+        void parameterize(ptrdiff_t first, ptrdiff_t last) {
+            parameters.resize(last - first + 1);
+            parameters[0] = 0;
+            for (ptrdiff_t i = first + 1; i <= last; i++) {
+                const cv::Point2d d = point(i) - point(i - 1);
+                parameters[i - first] = parameters[i - first - 1] + sqrt(d.dot(d));
+            }
+            const double length = parameters.back();
+            for (size_t i = 1; i < parameters.size(); i++) {
+                parameters[i] = length > 0 ? parameters[i] / length : i / double(parameters.size() - 1);
+            }
+        }
+
+        // Least squares handle lengths along fixed end tangents.
+        void generate(ptrdiff_t first, ptrdiff_t last, const cv::Point2d &leftTangent,
+                      const cv::Point2d &rightTangent, cv::Point2d *bezier) const {
+            const cv::Point2d start = point(first), end = point(last);
+            double c00 = 0, c01 = 0, c11 = 0, x0 = 0, x1 = 0;
+            for (ptrdiff_t i = first; i <= last; i++) {
+                const double t = parameters[i - first], s = 1 - t;
+                const double b0 = s * s * s, b1 = 3 * t * s * s, b2 = 3 * t * t * s, b3 = t * t * t;
+                const cv::Point2d a1 = leftTangent * b1, a2 = rightTangent * b2;
+                const cv::Point2d residual = point(i) - (start * (b0 + b1) + end * (b2 + b3));
+                c00 += a1.dot(a1);
+                c01 += a1.dot(a2);
+                c11 += a2.dot(a2);
+                x0 += a1.dot(residual);
+                x1 += a2.dot(residual);
+            }
+
+            const cv::Point2d chord = end - start;
+            const double chordLength = sqrt(chord.dot(chord));
+            const double det = c00 * c11 - c01 * c01;
+            double alphaLeft = 0, alphaRight = 0;
+            if (fabs(det) > BEZIER_CONDITION_EPSILON * max(c00 * c11, 1.0)) {
+                alphaLeft = (x0 * c11 - x1 * c01) / det;
+                alphaRight = (c00 * x1 - c01 * x0) / det;
+            }
+            // Negative or vanishing handles loop or cusp, the third of the
+            // chord is Schneider's fallback that stays well behaved.
+            const double minimum = 1e-6 * chordLength;
+            if (alphaLeft <= minimum || alphaRight <= minimum) {
+                alphaLeft = alphaRight = chordLength / 3;
+            }
+
+            bezier[0] = start;
+            bezier[1] = start + leftTangent * alphaLeft;
+            bezier[2] = end + rightTangent * alphaRight;
+            bezier[3] = end;
+        }
+
+        double maximumError(ptrdiff_t first, ptrdiff_t last, const cv::Point2d *bezier, ptrdiff_t &split) const {
+            double worst = 0;
+            split = (first + last) / 2;
+            for (ptrdiff_t i = first + 1; i < last; i++) {
+                const cv::Point2d d = bezierPoint(bezier, parameters[i - first]) - point(i);
+                const double error = d.dot(d);
+                if (error >= worst) {
+                    worst = error;
+                    split = i;
+                }
+            }
+            return worst;
+        }
+
+        // One Newton-Raphson step towards the closest curve point of each sample.
+        void reparameterize(ptrdiff_t first, ptrdiff_t last, const cv::Point2d *bezier) {
+            cv::Point2d firstDerivative[3], secondDerivative[2];
+            for (int i = 0; i < 3; i++) {
+                firstDerivative[i] = (bezier[i + 1] - bezier[i]) * 3;
+            }
+            for (int i = 0; i < 2; i++) {
+                secondDerivative[i] = (firstDerivative[i + 1] - firstDerivative[i]) * 2;
+            }
+            for (ptrdiff_t i = first + 1; i < last; i++) {
+                const double t = parameters[i - first], s = 1 - t;
+                const cv::Point2d difference = bezierPoint(bezier, t) - point(i);
+                const cv::Point2d d1 = firstDerivative[0] * (s * s) + firstDerivative[1] * (2 * t * s) +
+                                       firstDerivative[2] * (t * t);
+                const cv::Point2d d2 = secondDerivative[0] * s + secondDerivative[1] * t;
+                const double denominator = d1.dot(d1) + difference.dot(d2);
+                if (denominator != 0) {
+                    parameters[i - first] = min(1.0, max(0.0, t - difference.dot(d1) / denominator));
+                }
+            }
+        }
+
+        bool fitRange(ptrdiff_t first, ptrdiff_t last, const cv::Point2d &leftTangent,
+                      const cv::Point2d &rightTangent, cv::Point2d *bezier, ptrdiff_t &split) {
+            parameterize(first, last);
+            generate(first, last, leftTangent, rightTangent, bezier);
+            double error = maximumError(first, last, bezier, split);
+            if (error <= tolerance) {
+                return true;
+            }
+            if (error > 4 * tolerance) {
+                return false;
+            }
+            for (int iteration = 0; iteration < FITTING_REPARAMETERIZE_ITERATIONS; iteration++) {
+                reparameterize(first, last, bezier);
+                generate(first, last, leftTangent, rightTangent, bezier);
+                error = maximumError(first, last, bezier, split);
+                if (error <= tolerance) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    public:
+        CubicFitter(const Contour &contour, double tolerance, vector<double> &parameters,
+                    vector<FittedPiece> &pending) :
+                contour(contour), size((ptrdiff_t) contour.size()), tolerance(tolerance * tolerance),
+                parameters(parameters), pending(pending) {}
+
+        cv::Point2d leftTangent(ptrdiff_t first, ptrdiff_t last) const {
+            const ptrdiff_t span = min((ptrdiff_t) FITTING_TANGENT_SPAN, last - first);
+            return normalize(point(first + span) - point(first));
+        }
+
+        cv::Point2d rightTangent(ptrdiff_t first, ptrdiff_t last) const {
+            const ptrdiff_t span = min((ptrdiff_t) FITTING_TANGENT_SPAN, last - first);
+            return normalize(point(last - span) - point(last));
+        }
+
+        // Tangent through a smooth point, oriented backwards along the contour.
+        cv::Point2d centerTangent(ptrdiff_t center) const {
+            const ptrdiff_t span = min((ptrdiff_t) FITTING_TANGENT_SPAN, max((ptrdiff_t) 1, size / 4));
+            return normalize(point(center - span) - point(center + span));
+        }
+
+        void fitRun(ptrdiff_t first, ptrdiff_t last, const cv::Point2d &leftTangent,
+                    const cv::Point2d &rightTangent, vector<FittedPiece> &pieces) {
+            const size_t begin = pieces.size();
+
+            pending.clear();
+            FittedPiece run = {first, last, leftTangent, rightTangent};
+            pending.push_back(run);
+            while (!pending.empty()) {
+                FittedPiece piece = pending.back();
+                pending.pop_back();
+
+                ptrdiff_t split;
+                if (piece.last - piece.first < 2) {
+                    piece.bezier[0] = point(piece.first);
+                    piece.bezier[3] = point(piece.last);
+                    piece.line = true;
+                    pieces.push_back(piece);
+                } else if (fitRange(piece.first, piece.last, piece.leftTangent, piece.rightTangent,
+                                    piece.bezier, split)) {
+                    piece.line = false;
+                    pieces.push_back(piece);
+                } else {
+                    // The right half is pushed first so that pieces come out in
+                    // contour order, both halves share the tangent at the split.
+                    const cv::Point2d tangent = centerTangent(split);
+                    FittedPiece left = {piece.first, split, piece.leftTangent, tangent};
+                    FittedPiece right = {split, piece.last, -tangent, piece.rightTangent};
+                    pending.push_back(right);
+                    pending.push_back(left);
+                }
+            }
+
+            // Splitting at the worst point is greedy, so try to undo splits that
+            // a single cubic can cover after all.
+            size_t merged = begin;
+            for (size_t i = begin + 1; i < pieces.size(); i++) {
+                FittedPiece candidate = {pieces[merged].first, pieces[i].last, pieces[merged].leftTangent,
+                                         pieces[i].rightTangent};
+                ptrdiff_t split;
+                if (fitRange(candidate.first, candidate.last, candidate.leftTangent, candidate.rightTangent,
+                             candidate.bezier, split)) {
+                    candidate.line = false;
+                    pieces[merged] = candidate;
+                } else {
+                    pieces[++merged] = pieces[i];
+                }
+            }
+            if (pieces.size() > begin) {
+                pieces.resize(merged + 1);
+            }
+        }
+    };
+
+    static void findCorners(const Contour &contour, const vector<size_t> &breakpoints, vector<size_t> &corners) {
+        corners.clear();
+        const size_t count = breakpoints.size();
+        if (count < 3) {
+            return;
+        }
+        const double threshold = cos(FITTING_CORNER_ANGLE * CV_PI / 180);
+        for (size_t i = 0; i < count; i++) {
+            const cv::Point &previous = contour[breakpoints[(i + count - 1) % count]];
+            const cv::Point &current = contour[breakpoints[i]];
+            const cv::Point &next = contour[breakpoints[(i + 1) % count]];
+            const cv::Point2d in = normalize(cv::Point2d(current.x - previous.x, current.y - previous.y));
+            const cv::Point2d out = normalize(cv::Point2d(next.x - current.x, next.y - current.y));
+            if (in.dot(out) < threshold) {
+                corners.push_back(breakpoints[i]);
+            }
+        }
+    }
+
+    void AdaptiveFitting::fit(const Contour &contour, double tolerance, vector<CurveSegment> &segments) {
+        AdaptiveFitting fitter;
+        fitter.fitContour(contour, tolerance, segments);
+    }
+
+    void AdaptiveFitting::fitContour(const Contour &contour, double tolerance, vector<CurveSegment> &segments) {
+        const ptrdiff_t size = (ptrdiff_t) contour.size();
+        if (size < 3) {
+            segments.resize(contour.empty() ? 0 : 1);
+            if (!contour.empty()) {
+                segments[0].clear();
+                for (const auto &p : contour) {
+                    segments[0].push_back(cv::Point2f((float) p.x, (float) p.y));
+                }
+            }
+            return;
+        }
+
+        simplifier.simplifyContour(contour, tolerance, breakpoints);
+        findCorners(contour, breakpoints, corners);
+
+        CubicFitter fitter(contour, tolerance, parameters, pending);
+        pieces.clear();
+        if (corners.empty()) {
+            // A smooth loop has no natural ends, cut it in two halves that meet
+            // with matching tangents.
+            const ptrdiff_t start = breakpoints.empty() ? 0 : (ptrdiff_t) breakpoints[0];
+            const ptrdiff_t middle = start + size / 2;
+            const cv::Point2d startTangent = fitter.centerTangent(start);
+            const cv::Point2d middleTangent = fitter.centerTangent(middle);
+            fitter.fitRun(start, middle, -startTangent, middleTangent, pieces);
+            fitter.fitRun(middle, start + size, -middleTangent, startTangent, pieces);
+        } else {
+            for (size_t i = 0; i < corners.size(); i++) {
+                const ptrdiff_t first = (ptrdiff_t) corners[i];
+                const ptrdiff_t last = i + 1 < corners.size() ? (ptrdiff_t) corners[i + 1] : (ptrdiff_t) corners[0] + size;
+                fitter.fitRun(first, last, fitter.leftTangent(first, last), fitter.rightTangent(first, last), pieces);
+            }
+        }
+
+        // Segments left over from an earlier contour keep their capacity.
+        segments.resize(pieces.size());
+        for (size_t i = 0; i < pieces.size(); i++) {
+            const FittedPiece &piece = pieces[i];
+            CurveSegment &segment = segments[i];
+            segment.clear();
+            if (piece.line) {
+                segment.push_back(cv::Point2f((float) piece.bezier[0].x, (float) piece.bezier[0].y));
+                segment.push_back(cv::Point2f((float) piece.bezier[3].x, (float) piece.bezier[3].y));
+                continue;
+            }
+            for (int j = 0; j < BEZIER_ORDER; j++) {
+                segment.push_back(cv::Point2f((float) piece.bezier[j].x, (float) piece.bezier[j].y));
+            }
+        }
+    }
+}
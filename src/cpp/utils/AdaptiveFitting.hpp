@@ -0,0 +1,62 @@
+#ifndef AUTOSVG_WASM_ADAPTIVEFITTING_HPP
+#define AUTOSVG_WASM_ADAPTIVEFITTING_HPP
+
+#include <cstddef>
+#include <vector>
+#include <utils/Constants.hpp>
+#include <utils/BezierFitting.hpp>
+#include <utils/ContourSimplifier.hpp>
+
+#define FITTING_CORNER_ANGLE 70
+#define FITTING_TANGENT_SPAN 3
+#define FITTING_REPARAMETERIZE_ITERATIONS 4
+
+namespace pi {
+
+    /**
+     * Error bounded cubic fitting of a closed contour (Schneider's algorithm).
+     *
+     * The contour is cut only at corners. Each run between corners is fitted
+     * with tangent constrained cubics, reparameterised with Newton steps and
+     * split at the worst point only while the error exceeds the tolerance.
+     * Splits share their tangent, so the joins are G1, and neighbouring
+     * pieces are merged again whenever one cubic still fits both.
+     */
+    /**
+     * A fitted stretch [first, last] of contour indices, which may run past the
+     * end of the contour, with its end tangents and control points.
+     */
+    struct FittedPiece {
+        ptrdiff_t first;
+        ptrdiff_t last;
+        cv::Point2d leftTangent;
+        cv::Point2d rightTangent;
+        cv::Point2d bezier[BEZIER_ORDER];
+        bool line;
+    };
+
+    class AdaptiveFitting {
+    private:
+        ContourSimplifier simplifier;
+        std::vector<size_t> breakpoints;
+        std::vector<size_t> corners;
+        std::vector<double> parameters;
+        std::vector<FittedPiece> pieces;
+        std::vector<FittedPiece> pending;
+
+    public:
+        /**
+         * Replaces `segments` with cubics (or two point lines) that keep every
+         * contour point within `tolerance` pixels of the curve.
+         */
+        static void fit(const Contour &contour, double tolerance, std::vector<CurveSegment> &segments);
+
+        /**
+         * Same as fit(), reusing this fitter's scratch buffers and the
+         * segments already in `segments`.
+         */
+        void fitContour(const Contour &contour, double tolerance, std::vector<CurveSegment> &segments);
+    };
+}
+
+#endif //AUTOSVG_WASM_ADAPTIVEFITTING_HPP
@@ -0,0 +1,100 @@
+#include <cmath>
+
+#include "BezierFitting.hpp"
+
+using namespace std;
+
+namespace pi {
+    // Binomial coefficients of the cubic Bernstein basis.
+    static const double BERNSTEIN[BEZIER_ORDER] = {1, 3, 3, 1};
+
+    static inline void bernstein(double t, double *basis) {
+        const double s = 1 - t;
+        basis[0] = BERNSTEIN[0] * s * s * s;
+        basis[1] = BERNSTEIN[1] * t * s * s;
+        basis[2] = BERNSTEIN[2] * t * t * s;
+        basis[3] = BERNSTEIN[3] * t * t * t;
+    }
+
+    static inline double distance(const cv::Point &a, const cv::Point &b) {
+        const double dx = a.x - b.x;
+        const double dy = a.y - b.y;
+        return sqrt(dx * dx + dy * dy);
+    }
+
+    void BezierFitting::fit(const Contour &contour, size_t begin, size_t count, CurveSegment &segment) {
+        const size_t size = contour.size();
+        segment.clear();
+        if (count == 0 || size == 0) {
+            return;
+        }
+        if (count < BEZIER_ORDER) {
+            for (size_t i = 0; i < count; i++) {
+                const cv::Point &p = contour[(begin + i) % size];
+                segment.push_back(cv::Point2f((float) p.x, (float) p.y));
+            }
+            return;
+        }
+
+        const cv::Point &first = contour[begin % size];
+        const cv::Point &last = contour[(begin + count - 1) % size];
+
+        double length = 0;
+        for (size_t i = 1; i < count; i++) {
+            length += distance(contour[(begin + i) % size], contour[(begin + i - 1) % size]);
+        }
+        if (length == 0) {
+            segment.push_back(cv::Point2f((float) first.x, (float) first.y));
+            segment.push_back(cv::Point2f((float) last.x, (float) last.y));
+            return;
+        }
+
+        // Normal equations for the inner control points P1, P2:
+        // [c11 c12; c12 c22] [P1; P2] = [r1; r2], the same matrix for x and y.
+        double c11 = 0, c12 = 0, c22 = 0;
+        double r1x = 0, r1y = 0, r2x = 0, r2y = 0;
+        double travelled = 0;
+        double basis[BEZIER_ORDER];
+        for (size_t i = 0; i < count; i++) {
+            const cv::Point &p = contour[(begin + i) % size];
+            if (i > 0) {
+                travelled += distance(p, contour[(begin + i - 1) % size]);
+            }
+            bernstein(travelled / length, basis);
+
+            const double x = p.x - basis[0] * first.x - basis[3] * last.x;
+            const double y = p.y - basis[0] * first.y - basis[3] * last.y;
+            c11 += basis[1] * basis[1];
+            c12 += basis[1] * basis[2];
+            c22 += basis[2] * basis[2];
+            r1x += basis[1] * x;
+            r1y += basis[1] * y;
+            r2x += basis[2] * x;
+            r2y += basis[2] * y;
+        }
+
+        cv::Point2f p1, p2;
+        const double det = c11 * c22 - c12 * c12;
+        if (det > BEZIER_CONDITION_EPSILON * c11 * c22) {
+            p1 = cv::Point2f((float) ((c22 * r1x - c12 * r2x) / det), (float) ((c22 * r1y - c12 * r2y) / det));
+            p2 = cv::Point2f((float) ((c11 * r2x - c12 * r1x) / det), (float) ((c11 * r2y - c12 * r1y) / det));
+        } else {
+            // Not enough distinct parameters to separate P1 from P2: solve for
+            // a shared inner point, which is still the best fit of that family.
+            const double shared = c11 + 2 * c12 + c22;
+            if (shared <= BEZIER_CONDITION_EPSILON) {
+                segment.push_back(cv::Point2f((float) first.x, (float) first.y));
+                segment.push_back(cv::Point2f((float) last.x, (float) last.y));
+                return;
+            }
+            p1 = cv::Point2f((float) ((r1x + r2x) / shared), (float) ((r1y + r2y) / shared));
+            p2 = p1;
+        }
+
+        segment.reserve(BEZIER_ORDER);
+        segment.push_back(cv::Point2f((float) first.x, (float) first.y));
+        segment.push_back(p1);
+        segment.push_back(p2);
+        segment.push_back(cv::Point2f((float) last.x, (float) last.y));
+    }
+}
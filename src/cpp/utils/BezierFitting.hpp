@@ -0,0 +1,32 @@
+#ifndef AUTOSVG_WASM_BEZIERFITTING_HPP
+#define AUTOSVG_WASM_BEZIERFITTING_HPP
+
+#include <utils/Constants.hpp>
+
+#define BEZIER_ORDER 4
+#define BEZIER_CONDITION_EPSILON 1e-9
+
+namespace pi {
+
+    /**
+     * Least squares cubic bezier fit with fixed end points.
+     *
+     * Points are parameterised by chord length and the two inner control
+     * points come from a 2x2 normal system built in a single pass, so fitting
+     * a segment never touches the heap apart from the output segment itself.
+     */
+    class BezierFitting {
+    public:
+        /**
+         * Fits `count` points of `contour` starting at `begin`, wrapping around
+         * its end, and writes the control points into `segment`.
+         *
+         * Fewer than BEZIER_ORDER points are copied as they are. Coincident
+         * points collapse to a line and ill-conditioned systems fall back to a
+         * single shared inner control point, then to the chord.
+         */
+        static void fit(const Contour &contour, size_t begin, size_t count, CurveSegment &segment);
+    };
+}
+
+#endif //AUTOSVG_WASM_BEZIERFITTING_HPP
@@ -11,7 +11,7 @@
 typedef cv::Point3_<float> Pixel;
 typedef std::vector<cv::Point> Contour;
 typedef cv::Vec4i Hierarchy;
-typedef std::vector<cv::Point> CurveSegment;
+typedef std::vector<cv::Point2f> CurveSegment;
 
 struct SVGParam {
     const char *key;
@@ -26,10 +26,54 @@ struct Curve {
 
 #define SHARPNESS 4
 #define K_COLORS 3
+// Color count that lets the quantizer choose, see ColorQuantizer::autoClusterHistogram.
+#define AUTO_K_COLORS 0
+#define CONVERSION_WIDTH 600
+// Tiled conversion: estimated working set per tile pixel (the RGB copy, label
+// and visited maps and traced boundaries) and the smallest tile side.
+#define TILE_BYTES_PER_PIXEL 48
+#define MIN_TILE_SIZE 64
+// Pyramid conversion: coarse cells around a label change that are relabeled
+// at full resolution.
+#define PYRAMID_BAND_CELLS 1
+// Conversion sessions: segmentations (per color count) and fitted curves (per
+// color count and sharpness) kept for parameter changes.
+#define SESSION_CACHED_SEGMENTATIONS 8
+#define SESSION_CACHED_CURVES 32
+// Progressive svg output: curves fitted and written before the first flush,
+// each following batch is twice as large.
+#define PROGRESSIVE_FIRST_BATCH 16
+#define MAX_K_COLORS 256
+
+enum QuantizationEngine {
+    KMEANS_QUANTIZATION,
+    HISTOGRAM_QUANTIZATION
+};
+
+#define QUANTIZATION_ENGINE HISTOGRAM_QUANTIZATION
+
+enum TracingEngine {
+    CONTOUR_TRACING,
+    BOUNDARY_TRACING
+};
+
+#define TRACING_ENGINE BOUNDARY_TRACING
+
+enum FittingMode {
+    SIMPLIFIED_FITTING,
+    ADAPTIVE_FITTING
+};
+
+#define FITTING_MODE ADAPTIVE_FITTING
+// Contour stripes per thread when fitting in parallel, more stripes balance
+// uneven contour sizes better.
+#define FITTING_STRIPES_PER_THREAD 4
 
 struct SegmentedEdgeResult {
     std::vector<Contour> edges;
     std::vector<Pixel> colors;
+    std::vector<int> edgeLabels;
+    cv::Mat labels;
 };
 
 #define MINIMUM_CONTOUR_AREA 36
@@ -0,0 +1,108 @@
+#include <utility>
+
+#include "ContourSimplifier.hpp"
+
+using namespace std;
+
+namespace pi {
+    static inline double squaredDistance(const cv::Point &a, const cv::Point &b) {
+        const double dx = a.x - b.x;
+        const double dy = a.y - b.y;
+        return dx * dx + dy * dy;
+    }
+
+    static size_t farthestFrom(const Contour &contour, size_t origin) {
+        size_t farthest = origin;
+        double best = 0;
+        for (size_t i = 0; i < contour.size(); i++) {
+            const double distance = squaredDistance(contour[i], contour[origin]);
+            if (distance > best) {
+                best = distance;
+                farthest = i;
+            }
+        }
+        return farthest;
+    }
+
+    void ContourSimplifier::simplify(const Contour &contour, double epsilon, vector<size_t> &breakpoints) {
+        ContourSimplifier simplifier;
+        simplifier.simplifyContour(contour, epsilon, breakpoints);
+    }
+
+    void ContourSimplifier::simplifyContour(const Contour &contour, double epsilon, vector<size_t> &breakpoints) {
+        breakpoints.clear();
+        const size_t size = contour.size();
+        if (size < 3) {
+            for (size_t i = 0; i < size; i++) {
+                breakpoints.push_back(i);
+            }
+            return;
+        }
+
+        // A closed contour has no natural end points, so split it at two
+        // vertices that are far apart, which are kept in any simplification.
+        const size_t first = farthestFrom(contour, 0);
+        const size_t second = farthestFrom(contour, first);
+        keep.assign(size, 0);
+        keep[first] = 1;
+        keep[second] = 1;
+        if (first == second) {
+            breakpoints.push_back(first);
+            return;
+        }
+
+        // Ranges are offsets from `first` and may run past the end of the
+        // contour, [0, span] and [span, size] cover both chains.
+        const size_t span = (second + size - first) % size;
+        const double tolerance = epsilon * epsilon;
+        ranges.clear();
+        ranges.push_back(make_pair((size_t) 0, span));
+        ranges.push_back(make_pair(span, size));
+
+        while (!ranges.empty()) {
+            const size_t begin = ranges.back().first;
+            const size_t end = ranges.back().second;
+            ranges.pop_back();
+            if (end - begin < 2) {
+                continue;
+            }
+
+            const cv::Point &a = contour[(first + begin) % size];
+            const cv::Point &b = contour[(first + end) % size];
+            const double dx = b.x - a.x;
+            const double dy = b.y - a.y;
+            const double length = dx * dx + dy * dy;
+
+            // Within one range the chord is fixed, so the farthest point is the
+            // one with the largest cross product and no division is needed.
+            size_t farthest = begin;
+            double best = 0;
+            for (size_t i = begin + 1; i < end; i++) {
+                const cv::Point &p = contour[(first + i) % size];
+                double distance;
+                if (length == 0) {
+                    distance = squaredDistance(p, a);
+                } else {
+                    const double cross = (p.x - a.x) * dy - (p.y - a.y) * dx;
+                    distance = cross * cross;
+                }
+                if (distance > best) {
+                    best = distance;
+                    farthest = i;
+                }
+            }
+
+            if (best > tolerance * (length == 0 ? 1 : length)) {
+                keep[(first + farthest) % size] = 1;
+                ranges.push_back(make_pair(begin, farthest));
+                ranges.push_back(make_pair(farthest, end));
+            }
+        }
+
+        for (size_t i = 0; i < size; i++) {
+            if (keep[i]) {
+                breakpoints.push_back(i);
+            }
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef AUTOSVG_WASM_CONTOURSIMPLIFIER_HPP
+#define AUTOSVG_WASM_CONTOURSIMPLIFIER_HPP
+
+#include <utility>
+#include <vector>
+#include <utils/Constants.hpp>
+
+namespace pi {
+
+    /**
+     * Douglas-Peucker simplification of a closed contour that reports the
+     * kept vertices as indices into the contour rather than as copied points,
+     * so callers can cut the original contour at them directly.
+     */
+    class ContourSimplifier {
+    private:
+        std::vector<char> keep;
+        std::vector<std::pair<size_t, size_t>> ranges;
+
+    public:
+        /**
+         * Fills `breakpoints` with the ascending indices of the vertices that
+         * keep every point within `epsilon` of the simplified polygon.
+         */
+        static void simplify(const Contour &contour, double epsilon, std::vector<size_t> &breakpoints);
+
+        /**
+         * Same as simplify(), reusing this simplifier's scratch buffers.
+         */
+        void simplifyContour(const Contour &contour, double epsilon, std::vector<size_t> &breakpoints);
+    };
+}
+
+#endif //AUTOSVG_WASM_CONTOURSIMPLIFIER_HPP
@@ -3,273 +3,141 @@
 //
 
 #include "CurveUtils.hpp"
-#include "underscore.hpp"
-#include <NumCpp.hpp>
+#include "PathEncoder.hpp"
+#include "BezierFitting.hpp"
+#include "ContourSimplifier.hpp"
+#include "AdaptiveFitting.hpp"
 
 using namespace std;
 
-void join(const vector<string> &v, char c, string &s) {
-    s.clear();
-    for (auto p = v.begin();
-         p != v.end(); ++p) {
-        s += *p;
-        if (p != v.end() - 1 && c != NULL)
-            s += c;
-    }
-}
-
-
-typedef nc::int8 PixelType;
-
 namespace pi {
-    class HTMLTag {
-    private:
-        const char *tagName;
-        vector<SVGParam> params;
-
-        string serializeParameters(const vector<SVGParam> &params) {
-            string output;
-            for (auto param: params) {
-                join({output, " ", param.key, "=\"", param.value, "\""}, NULL, output);
-            }
-            return output;
-        }
-
-    public:
-        string children = "";
-
-        HTMLTag(const char *tagName, const vector<SVGParam> &params) {
-            this->tagName = tagName;
-            for (auto param : params) {
-                this->params.emplace_back(param);
-            }
-        }
-
-        string serialize() {
-            string output;
-            join({"<", this->tagName, " ", this->serializeParameters(this->params)}, NULL, output);
-
-            if (this->children.empty()) {
-                join({output, " />"}, NULL, output);
-                return output;
-            }
-
-            join({output, " >", this->children, "</", this->tagName, ">"}, NULL, output);
-            return output;
-        }
-    };
-
-    class BezierApproximation {
-    private:
-        static inline PixelType nCr(int n, int r) {
-            return fact(n) / (fact(r) * fact(n - r));
-        }
-
-        static inline PixelType fact(int n) {
-            PixelType res = 1;
-            for (PixelType i = 2; i <= n; i++) {
-                res = res * i;
-            }
-            return res;
-        }
+    vector<Curve>
+    CurveUtils::convertContoursToBezierCurves(const vector<Contour> &contours, int sharpness,
+                                              const vector<Pixel> &colors, FittingMode fitting) {
+        vector<Curve> output;
+        vector<AdaptiveFitting> fitters;
+        CurveUtils::convertContoursToBezierCurves(contours, sharpness, colors, fitting, output, fitters);
+        return output;
+    }
 
-        template<typename dtype>
-        static nc::NdArray<dtype> baseMatrixM(unsigned short n) {
-            auto M = nc::zeros<dtype>(n, n);
-            for (int i = 0; i < n; i++) {
-                M.at(i, i) = BezierApproximation::nCr(n - 1, i);
-            }
-            for (int i = 0; i < n; i++) {
-                for (int j = i + 1; j < n; j++) {
-                    int sign = (i + j) % 2 == 1 ? -1 : 1;
-                    auto value = BezierApproximation::nCr(j, i) * M.at(j, j);
-                    M.at(j, i) = (dtype) (sign * value);
-                }
-            }
-            return M;
-        }
+    void CurveUtils::convertContoursToBezierCurves(const vector<Contour> &contours, int sharpness,
+                                                   const vector<Pixel> &colors, FittingMode fitting,
+                                                   vector<Curve> &output, vector<AdaptiveFitting> &fitters) {
+        output.resize(contours.size());
+        CurveUtils::convertContoursToBezierCurves(contours, nullptr, contours.size(), sharpness, colors, fitting,
+                                                  output, fitters);
+    }
 
-        static nc::NdArray<double> distanceMatrixS(const nc::NdArray<double> &points) {
-            auto length = (nc::uint16) points.shape().rows;
-            auto S = nc::zeros<double>(length, 1);
-            for (int i = 1; i < length; i++) {
-                auto p1X = points.at(i, 0);
-                auto p2X = points.at(i - 1, 0);
-                auto p1Y = points.at(i, 1);
-                auto p2Y = points.at(i - 1, 1);
-                S.at(i) = S.at(i - 1) + sqrt(pow((p1X - p2X) * 1.0, 2) + pow((p1Y - p2Y) * 1.0, 2));
-            }
-            auto perimeter = S.at(length - 1);
-            for (int i = 1; i < length; i++) {
-                S.at(i) /= perimeter;
-            }
-            return S;
+    void CurveUtils::convertContoursToBezierCurves(const vector<Contour> &contours, const size_t *order,
+                                                   size_t count, int sharpness, const vector<Pixel> &colors,
+                                                   FittingMode fitting, vector<Curve> &output,
+                                                   vector<AdaptiveFitting> &fitters) {
+        if (count == 0) {
+            return;
         }
 
-        static CurveSegment convertCurveSegment(const nc::NdArray<double> &A) {
-            CurveSegment segment;
-            auto rows = A.shape().rows;
-            auto cols = A.shape().cols;
-            assert(cols == 2);
-            for (int i = 0; i < rows; i++) {
-                segment.push_back({int(A.at(i, 0)), int(A.at(i, 1))});
-            }
-            return segment;
+        // Contours are split into contiguous stripes, each fitted with its own
+        // scratch, so the curves do not depend on the number of threads.
+        const size_t stripes = min(count, size_t(max(1, cv::getNumThreads())) * FITTING_STRIPES_PER_THREAD);
+        if (fitters.size() < stripes) {
+            fitters.resize(stripes);
         }
-
-    public:
-        static CurveSegment fit(const Contour &contour, unsigned short n) {
-            auto length = (nc::uint16) contour.size();
-            auto P = nc::zeros<double>(length, 2);
-            for (int i = 0; i < length; i++) {
-                P.at(i, 0) = (double) contour[i].x;
-                P.at(i, 1) = (double) contour[i].y;
-            }
-            if (n < 3) {
-                return BezierApproximation::convertCurveSegment(P);
-            }
-            auto M = BezierApproximation::baseMatrixM<double>(n);
-            auto S = BezierApproximation::distanceMatrixS(P);
-            auto T = nc::ones<double>(length, n);
-            for (int x = 0; x < T.shape().rows; x++) {
-                for (int y = 1; y < n; y++) {
-                    T.at(x, y) = pow(S.at(x), y);
+        cv::parallel_for_(cv::Range(0, (int) stripes), [&](const cv::Range &range) {
+            for (int stripe = range.start; stripe < range.end; stripe++) {
+                AdaptiveFitting &fitter = fitters[stripe];
+                const size_t end = count * (stripe + 1) / stripes;
+                for (size_t i = count * stripe / stripes; i < end; i++) {
+                    const size_t index = order ? order[i] : i;
+                    const Contour &contour = contours[index];
+                    Curve &curve = output[index];
+                    if (fitting == ADAPTIVE_FITTING) {
+                        fitter.fitContour(contour, sharpness, curve.segments);
+                    } else {
+                        curve.segments = CurveUtils::fitContourToCurve(contour, sharpness);
+                    }
+                    curve.area = cv::contourArea(contour);
+                    curve.color = colors[index];
                 }
             }
-            auto Tt = T.transpose();
-            auto M1 = nc::linalg::inv<double>(M);
-            auto temp = nc::linalg::inv(Tt.dot(T));
-            auto A = nc::linalg::multi_dot<double>({M1, temp, Tt, P});
-            return BezierApproximation::convertCurveSegment(A);
-        }
-    };
+        });
+    }
 
-    vector<Curve>
-    CurveUtils::convertContoursToBezierCurves(const vector<Contour> &contours, int sharpness,
-                                              const vector<Pixel> &colors) {
-        vector<Curve> output;
-        for (int i = 0; i < contours.size(); i++) {
-            Contour contour = contours[i];
-            Curve curve;
-            curve.segments = CurveUtils::fitContourToCurve(contour, sharpness);
-            curve.area = cv::contourArea(contour);
-            curve.color = colors[i];
-            output.push_back(curve);
+    void CurveUtils::paintOrder(const vector<Contour> &contours, vector<size_t> &order) {
+        vector<double> areas(contours.size());
+        order.resize(contours.size());
+        for (size_t i = 0; i < contours.size(); i++) {
+            areas[i] = cv::contourArea(contours[i]);
+            order[i] = i;
         }
-        return output;
+        stable_sort(order.begin(), order.end(), [&areas](size_t a, size_t b) -> bool {
+            return areas[a] > areas[b];
+        });
     }
 
     string CurveUtils::createSvgFromBezierCurves(const vector<Curve> &curves,
-                                                 const vector<SVGParam> &params) {
-        HTMLTag svgTag("svg", params);
-
-        vector<Curve> sortedCurves(curves.size());
-
-        partial_sort_copy(
-                curves.begin(), curves.end(),
-                sortedCurves.begin(), sortedCurves.end(),
-                [](const Curve &a, const Curve &b) -> bool {
-                    return a.area > b.area;
-                });
-
-        join(underscore::map<vector<string>>(sortedCurves, [](const Curve &item) -> string {
-            string color;
-            join({"rgb(", to_string(int(item.color.x)),
-                  ",", to_string(int(item.color.y)),
-                  ",", to_string(int(item.color.z)), ")"},
-                 NULL, color);
-            HTMLTag pathTag("path", {
-                    {"d",    CurveUtils::convertCurveIntoSvgPathData(item)},
-                    {"fill", color}
-            });
-
-            return pathTag.serialize();
-        }), '\n', svgTag.children);
-        return svgTag.serialize();
+                                                 const vector<SVGParam> &params,
+                                                 const PathDataOptions &pathData) {
+        BufferSink sink;
+        CurveUtils::writeSvgFromBezierCurves(curves, params, sink, pathData);
+        return std::move(sink.buffer);
     }
 
-    string CurveUtils::convertCurveIntoSvgPathData(const Curve &curve) {
-        unsigned long lastSegmentSize = 0;
-        return underscore::reduce(curve.segments,
-                                  [&lastSegmentSize](string accum, const CurveSegment segment) -> string {
-                                      string command = accum.empty() ? " M " : " L ";
-                                      const auto isLine = segment.size() < 4;
-                                      auto index = 0;
-                                      auto lineString = underscore::reduce(segment,
-                                                                           [&isLine, &command, &lastSegmentSize, &index](
-                                                                                   string line,
-                                                                                   cv::Point point) -> string {
-                                                                               string data;
-                                                                               if ((index == 0 &&
-                                                                                    lastSegmentSize != 4) || isLine) {
-                                                                                   join({data, line, command,
-                                                                                         to_string(point.x), " ",
-                                                                                         to_string(point.y)}, NULL,
-                                                                                        data);
-                                                                               } else if (!isLine && index == 1) {
-                                                                                   join({data, line, " C ",
-                                                                                         to_string(point.x), " ",
-                                                                                         to_string(point.y)}, NULL,
-                                                                                        data);
-                                                                               } else if (!isLine && index > 1) {
-                                                                                   join({data, line, ", ",
-                                                                                         to_string(point.x), ", ",
-                                                                                         to_string(point.y)}, NULL,
-                                                                                        data);
-                                                                               }
-                                                                               index++;
-                                                                               return data;
-                                                                           }, (string) "");
-
-                                      string result;
-                                      lastSegmentSize = segment.size();
-                                      join({accum, lineString}, '\n', result);
+    void CurveUtils::writeSvgFromBezierCurves(const vector<Curve> &curves, const vector<SVGParam> &params,
+                                              SvgSink &sink, const PathDataOptions &pathData,
+                                              vector<char> *buffer) {
+        vector<const Curve *> sortedCurves(curves.size());
+        for (size_t i = 0; i < curves.size(); i++) {
+            sortedCurves[i] = &curves[i];
+        }
+        stable_sort(sortedCurves.begin(), sortedCurves.end(), [](const Curve *a, const Curve *b) -> bool {
+            return a->area > b->area;
+        });
+
+        vector<char> ownBuffer;
+        SvgWriter writer(sink, buffer ? *buffer : ownBuffer);
+        PathEncoder encoder(writer, pathData);
+        writer.begin(params);
+        for (auto curve : sortedCurves) {
+            writer.beginPath();
+            encoder.encode(*curve);
+            writer.endPath(curve->color);
+        }
+        writer.end();
+    }
 
-                                      return result;
-                                  }, (string) "");
+    string CurveUtils::convertCurveIntoSvgPathData(const Curve &curve, const PathDataOptions &pathData) {
+        BufferSink sink(0);
+        {
+            SvgWriter writer(sink, 1024);
+            PathEncoder encoder(writer, pathData);
+            encoder.encode(curve);
+        }
+        return std::move(sink.buffer);
     }
 
     vector<CurveSegment> CurveUtils::fitContourToCurve(const Contour &contour, int sharpness) {
-        Contour approxCurve;
-        cv::approxPolyDP(contour, approxCurve, sharpness, true);
+        vector<size_t> breakpoints;
+        ContourSimplifier::simplify(contour, sharpness, breakpoints);
 
         vector<CurveSegment> output;
+        if (breakpoints.empty()) {
+            return output;
+        }
 
-        int current_point_index = 0;
-        int previous_point_index = 0;
-
-        Contour partition;
-        for (int i = 0; i < contour.size(); i++) {
-            auto p1 = contour[i];
-            if (partition.empty()) {
-                partition.push_back(p1);
-                continue;
-            }
-            previous_point_index = current_point_index;
-            for (int j = current_point_index; j < approxCurve.size(); j++) {
-                if (approxCurve[j].x == p1.x && approxCurve[j].y == p1.y) {
-                    current_point_index = j;
-                    break;
-                }
-            }
-
-            if (
-                    current_point_index != previous_point_index or
-                    (partition.size() > 1 and i == contour.size() - 1)) {
-                auto C = CurveUtils::fitPointsToCurveSegment(partition);
-                current_point_index = 0;
-                previous_point_index = current_point_index;
-                partition.clear();
-                output.push_back(C);
-            } else {
-                partition.push_back(p1);
-            }
+        // Each segment runs from one breakpoint up to and including the next,
+        // the last one wrapping around to close the contour.
+        const size_t size = contour.size();
+        output.resize(breakpoints.size());
+        for (size_t i = 0; i < breakpoints.size(); i++) {
+            const size_t begin = breakpoints[i];
+            const size_t end = i + 1 < breakpoints.size() ? breakpoints[i + 1] : breakpoints[0] + size;
+            CurveUtils::fitPointsToCurveSegment(contour, begin, end - begin + 1, output[i]);
         }
         return output;
     }
 
-    CurveSegment CurveUtils::fitPointsToCurveSegment(const Contour &contour) {
-        unsigned short n = min((unsigned short) 4, (unsigned short) contour.size());
-        return BezierApproximation::fit(contour, n);
+    void CurveUtils::fitPointsToCurveSegment(const Contour &contour, size_t begin, size_t count,
+                                             CurveSegment &segment) {
+        BezierFitting::fit(contour, begin, count, segment);
     }
-}
\ No newline at end of file
+}
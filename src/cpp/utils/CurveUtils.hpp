@@ -11,23 +11,69 @@ using namespace std;
 
 #include <string>
 #include <utils/Constants.hpp>
+#include <utils/SvgWriter.hpp>
+#include <utils/PathEncoder.hpp>
+#include <utils/AdaptiveFitting.hpp>
 
 namespace pi {
 
     class CurveUtils {
     public:
+        /**
+         * Fits every contour with cubics. In ADAPTIVE_FITTING mode `sharpness`
+         * is the maximum distance in pixels between the contour and its curve,
+         * otherwise it is the polygon simplification tolerance.
+         */
         static vector<Curve>
         convertContoursToBezierCurves(const vector<Contour> &contours, int sharpness,
-                                      const vector<Pixel> &colors);
+                                      const vector<Pixel> &colors, FittingMode fitting = FITTING_MODE);
 
-        static string createSvgFromBezierCurves(const vector<Curve> &curves, const vector<SVGParam> &params);
+        /**
+         * Same as above, reusing the curves already in `output` and the
+         * buffers of `fitters`. Contours are fitted in parallel, `fitters`
+         * grows to one per stripe of contours.
+         */
+        static void
+        convertContoursToBezierCurves(const vector<Contour> &contours, int sharpness, const vector<Pixel> &colors,
+                                      FittingMode fitting, vector<Curve> &output, vector<AdaptiveFitting> &fitters);
+
+        /**
+         * Fits the `count` contours at the indices in `order` into the curves
+         * at the same indices of `output`, which must hold one per contour.
+         */
+        static void
+        convertContoursToBezierCurves(const vector<Contour> &contours, const size_t *order, size_t count,
+                                      int sharpness, const vector<Pixel> &colors, FittingMode fitting,
+                                      vector<Curve> &output, vector<AdaptiveFitting> &fitters);
+
+        /**
+         * Indices of `contours` in the order their curves are painted, largest
+         * area first and stable for equal areas, as in writeSvgFromBezierCurves.
+         */
+        static void paintOrder(const vector<Contour> &contours, vector<size_t> &order);
+
+        static string createSvgFromBezierCurves(const vector<Curve> &curves, const vector<SVGParam> &params,
+                                                const PathDataOptions &pathData = PathDataOptions());
+
+        /**
+         * Streams the svg document into `sink`, largest curves first.
+         */
+        static void writeSvgFromBezierCurves(const vector<Curve> &curves, const vector<SVGParam> &params,
+                                             SvgSink &sink, const PathDataOptions &pathData = PathDataOptions(),
+                                             vector<char> *buffer = nullptr);
+
+        static string convertCurveIntoSvgPathData(const Curve &curve,
+                                                  const PathDataOptions &pathData = PathDataOptions());
 
     private:
-        static string convertCurveIntoSvgPathData(const Curve &curves);
 
         static vector<CurveSegment> fitContourToCurve(const Contour &contour, int sharpness = SHARPNESS);
 
-        static CurveSegment fitPointsToCurveSegment(const Contour &contourPart);
+        /**
+         * Fits `count` points of `contour` from `begin`, wrapping around its end.
+         */
+        static void fitPointsToCurveSegment(const Contour &contour, size_t begin, size_t count,
+                                            CurveSegment &segment);
     };
 
 }
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cmath>
+
+#include "PathEncoder.hpp"
+
+using namespace std;
+
+namespace pi {
+    PathEncoder::PathEncoder(SvgWriter &writer, const PathDataOptions &options) :
+            writer(writer),
+            relative(options.relative),
+            precision(min(max(options.precision, 0), PATH_DATA_MAX_PRECISION)) {
+        for (int i = 0; i < precision; i++) {
+            scale *= 10;
+        }
+    }
+
+    long long PathEncoder::quantize(double value) const {
+        return llround(value * scale);
+    }
+
+    void PathEncoder::emitCommand(char absolute) {
+        const char letter = relative && absolute != 'M' ? char(absolute - 'A' + 'a') : absolute;
+        if (letter != command) {
+            writer.append(letter);
+            command = letter;
+            afterNumber = false;
+        }
+    }
+
+    void PathEncoder::emitNumber(long long value) {
+        char text[32];
+        char *end = text + sizeof(text);
+        char *cursor = end;
+
+        unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long) value : (unsigned long long) value;
+        unsigned long long fraction = magnitude % scale;
+        unsigned long long integer = magnitude / scale;
+
+        bool hasDot = false;
+        if (fraction != 0) {
+            int digits = precision;
+            while (fraction % 10 == 0) {
+                fraction /= 10;
+                digits--;
+            }
+            for (; digits > 0; digits--) {
+                *--cursor = char('0' + fraction % 10);
+                fraction /= 10;
+            }
+            *--cursor = '.';
+            hasDot = true;
+        }
+        if (integer != 0 || !hasDot) {
+            do {
+                *--cursor = char('0' + integer % 10);
+                integer /= 10;
+            } while (integer > 0);
+        }
+        if (value < 0) {
+            *--cursor = '-';
+        }
+
+        // A separator is only needed where the two numbers would otherwise merge.
+        if (afterNumber && *cursor != '-' && !(*cursor == '.' && lastHadDot)) {
+            writer.append(' ');
+        }
+        writer.append(cursor, end - cursor);
+        afterNumber = true;
+        lastHadDot = hasDot;
+    }
+
+    void PathEncoder::moveTo(long long px, long long py) {
+        emitCommand('M');
+        emitNumber(px);
+        emitNumber(py);
+        x = px;
+        y = py;
+    }
+
+    void PathEncoder::lineTo(long long px, long long py) {
+        if (px == x && py == y) {
+            return;
+        }
+        if (py == y) {
+            emitCommand('H');
+            emitNumber(relative ? px - x : px);
+        } else if (px == x) {
+            emitCommand('V');
+            emitNumber(relative ? py - y : py);
+        } else {
+            emitCommand('L');
+            emitNumber(relative ? px - x : px);
+            emitNumber(relative ? py - y : py);
+        }
+        x = px;
+        y = py;
+    }
+
+    void PathEncoder::cubicTo(const long long *points) {
+        emitCommand('C');
+        for (int i = 0; i < 3; i++) {
+            emitNumber(relative ? points[2 * i] - x : points[2 * i]);
+            emitNumber(relative ? points[2 * i + 1] - y : points[2 * i + 1]);
+        }
+        x = points[4];
+        y = points[5];
+    }
+
+    void PathEncoder::encode(const Curve &curve) {
+        command = 0;
+        afterNumber = false;
+        lastHadDot = false;
+
+        bool started = false;
+        for (const auto &segment : curve.segments) {
+            if (segment.empty()) {
+                continue;
+            }
+            const long long firstX = quantize(segment[0].x), firstY = quantize(segment[0].y);
+            if (!started) {
+                moveTo(firstX, firstY);
+                started = true;
+            } else {
+                lineTo(firstX, firstY);
+            }
+
+            if (segment.size() == 4) {
+                long long controls[6];
+                for (int i = 0; i < 3; i++) {
+                    controls[2 * i] = quantize(segment[i + 1].x);
+                    controls[2 * i + 1] = quantize(segment[i + 1].y);
+                }
+                cubicTo(controls);
+                continue;
+            }
+            for (size_t i = 1; i < segment.size(); i++) {
+                lineTo(quantize(segment[i].x), quantize(segment[i].y));
+            }
+        }
+        if (started) {
+            writer.append(relative ? 'z' : 'Z');
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef AUTOSVG_WASM_PATHENCODER_HPP
+#define AUTOSVG_WASM_PATHENCODER_HPP
+
+#include <utils/Constants.hpp>
+#include <utils/SvgWriter.hpp>
+
+#define PATH_DATA_PRECISION 1
+#define PATH_DATA_MAX_PRECISION 6
+
+namespace pi {
+
+    struct PathDataOptions {
+        int precision = PATH_DATA_PRECISION;
+        bool relative = true;
+    };
+
+    /**
+     * Writes compact svg path data for a curve in one pass: numbers are rounded
+     * to `precision` decimals with redundant zeros and separators dropped,
+     * repeated commands are implicit, axis aligned lines use H/V and, unless
+     * disabled, coordinates are relative to the current point.
+     *
+     * Relative offsets are taken between already rounded coordinates, so
+     * rounding errors never accumulate along the path.
+     */
+    class PathEncoder {
+    private:
+        SvgWriter &writer;
+        bool relative;
+        int precision;
+        long long scale = 1;
+
+        char command = 0;
+        long long x = 0, y = 0;
+        bool afterNumber = false;
+        bool lastHadDot = false;
+
+        long long quantize(double value) const;
+
+        void emitCommand(char absolute);
+
+        void emitNumber(long long value);
+
+        void moveTo(long long px, long long py);
+
+        void lineTo(long long px, long long py);
+
+        void cubicTo(const long long *points);
+
+    public:
+        PathEncoder(SvgWriter &writer, const PathDataOptions &options = PathDataOptions());
+
+        void encode(const Curve &curve);
+    };
+}
+
+#endif //AUTOSVG_WASM_PATHENCODER_HPP
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
+
+#include "Profiler.hpp"
+
+using namespace std;
+
+namespace pi {
+    Profiler::AllocationReader Profiler::allocationReader = nullptr;
+
+    /**
+     * Cpu time of the calling thread, so that stages running concurrently on
+     * other threads are not charged to it. Work the stage hands to OpenCV's
+     * thread pool is not included. Falls back to the process cpu time where
+     * the thread clock is not available.
+     */
+    static inline double cpuSeconds() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+        struct timespec now;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) == 0) {
+            return now.tv_sec + now.tv_nsec * 1e-9;
+        }
+#endif
+        return clock() / double(CLOCKS_PER_SEC);
+    }
+
+    static inline void readAllocations(size_t *count, size_t *bytes) {
+        if (Profiler::allocationReader) {
+            Profiler::allocationReader(count, bytes);
+        } else {
+            *count = *bytes = 0;
+        }
+    }
+
+    Profiler::Profiler() : origin(chrono::steady_clock::now()) {}
+
+    double Profiler::now() const {
+        return chrono::duration<double>(chrono::steady_clock::now() - origin).count();
+    }
+
+    void Profiler::add(ProfileStage stage) {
+        lock_guard<std::mutex> lock(mutex);
+        const auto id = this_thread::get_id();
+        auto thread = find(threads.begin(), threads.end(), id);
+        if (thread == threads.end()) {
+            thread = threads.insert(threads.end(), id);
+        }
+        stage.thread = (unsigned int) (thread - threads.begin());
+        recorded.push_back(std::move(stage));
+    }
+
+    vector<ProfileStage> Profiler::stages() const {
+        lock_guard<std::mutex> lock(mutex);
+        return recorded;
+    }
+
+    void Profiler::writeJson(ostream &stream) const {
+        const auto all = stages();
+
+        // Totals per stage name, in the order stages first ran.
+        vector<ProfileStage> totals;
+        vector<size_t> counts;
+        for (const auto &stage : all) {
+            auto total = find_if(totals.begin(), totals.end(), [&](const ProfileStage &t) {
+                return t.name == stage.name;
+            });
+            if (total == totals.end()) {
+                ProfileStage empty;
+                empty.name = stage.name;
+                total = totals.insert(totals.end(), empty);
+                counts.push_back(0);
+            }
+            counts[total - totals.begin()]++;
+            total->wall += stage.wall;
+            total->cpu += stage.cpu;
+            total->allocations += stage.allocations;
+            total->bytes += stage.bytes;
+            total->items += stage.items;
+        }
+
+        stream << fixed << setprecision(6);
+        stream << "{\n  \"wallSeconds\": " << now() << ",\n  \"stages\": [";
+        for (size_t i = 0; i < all.size(); i++) {
+            const auto &stage = all[i];
+            stream << (i ? "," : "") << "\n    {\"name\": \"" << stage.name << "\", \"thread\": " << stage.thread
+                   << ", \"start\": " << stage.start << ", \"wall\": " << stage.wall << ", \"cpu\": " << stage.cpu
+                   << ", \"allocations\": " << stage.allocations << ", \"bytes\": " << stage.bytes
+                   << ", \"items\": " << stage.items << "}";
+        }
+        stream << "\n  ],\n  \"totals\": [";
+        for (size_t i = 0; i < totals.size(); i++) {
+            const auto &total = totals[i];
+            stream << (i ? "," : "") << "\n    {\"name\": \"" << total.name << "\", \"count\": " << counts[i]
+                   << ", \"wall\": " << total.wall << ", \"cpu\": " << total.cpu
+                   << ", \"allocations\": " << total.allocations << ", \"bytes\": " << total.bytes
+                   << ", \"items\": " << total.items << "}";
+        }
+        stream << "\n  ]\n}\n";
+    }
+
+    void Profiler::writeChromeTrace(ostream &stream) const {
+        const auto all = stages();
+        stream << fixed << setprecision(3);
+        stream << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+        for (size_t i = 0; i < all.size(); i++) {
+            const auto &stage = all[i];
+            stream << (i ? "," : "") << "\n  {\"name\": \"" << stage.name
+                   << "\", \"cat\": \"autosvg\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << stage.thread
+                   << ", \"ts\": " << stage.start * 1e6 << ", \"dur\": " << stage.wall * 1e6
+                   << ", \"args\": {\"cpuMs\": " << stage.cpu * 1e3 << ", \"allocations\": " << stage.allocations
+                   << ", \"bytes\": " << stage.bytes << ", \"items\": " << stage.items << "}}";
+        }
+        stream << "\n]}\n";
+    }
+
+    ProfileScope::ProfileScope(Profiler *profiler, const char *name) : profiler(profiler) {
+        if (!profiler) {
+            return;
+        }
+        stage.name = name;
+        readAllocations(&allocationStart, &byteStart);
+        cpuStart = cpuSeconds();
+        stage.start = profiler->now();
+    }
+
+    ProfileScope::~ProfileScope() {
+        if (!profiler) {
+            return;
+        }
+        stage.wall += profiler->now() - stage.start;
+        stage.cpu += cpuSeconds() - cpuStart;
+        size_t allocations, bytes;
+        readAllocations(&allocations, &bytes);
+        stage.allocations += allocations - allocationStart;
+        stage.bytes += bytes - byteStart;
+        profiler->add(std::move(stage));
+    }
+
+    void ProfileScope::exclude(const ProfileStage &nested) {
+        stage.wall -= nested.wall;
+        stage.cpu -= nested.cpu;
+        stage.allocations -= nested.allocations;
+        stage.bytes -= nested.bytes;
+    }
+
+    struct SinkCall {
+        double start;
+        double cpu;
+        size_t allocations;
+        size_t bytes;
+    };
+
+    static inline SinkCall beginCall(const Profiler *profiler) {
+        SinkCall call;
+        call.start = profiler->now();
+        call.cpu = cpuSeconds();
+        readAllocations(&call.allocations, &call.bytes);
+        return call;
+    }
+
+    static inline void endCall(const Profiler *profiler, const SinkCall &call, ProfileStage &stage) {
+        size_t allocations, bytes;
+        readAllocations(&allocations, &bytes);
+        stage.wall += profiler->now() - call.start;
+        stage.cpu += cpuSeconds() - call.cpu;
+        stage.allocations += allocations - call.allocations;
+        stage.bytes += bytes - call.bytes;
+    }
+
+    ProfiledSink::ProfiledSink(SvgSink &sink, Profiler *profiler) : sink(sink), profiler(profiler) {
+        writeStage.name = "write";
+    }
+
+    void ProfiledSink::write(const char *data, size_t size) {
+        if (!profiler) {
+            sink.write(data, size);
+            return;
+        }
+        const SinkCall call = beginCall(profiler);
+        if (!started) {
+            writeStage.start = call.start;
+            started = true;
+        }
+        sink.write(data, size);
+        endCall(profiler, call, writeStage);
+        writeStage.items += size;
+    }
+
+    void ProfiledSink::flush() {
+        if (!profiler) {
+            sink.flush();
+            return;
+        }
+        const SinkCall call = beginCall(profiler);
+        sink.flush();
+        endCall(profiler, call, writeStage);
+    }
+
+    void ProfiledSink::finish() {
+        if (profiler && started) {
+            profiler->add(writeStage);
+            started = false;
+        }
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef AUTOSVG_WASM_PROFILER_HPP
+#define AUTOSVG_WASM_PROFILER_HPP
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utils/SvgWriter.hpp>
+
+namespace pi {
+
+    struct ProfileStage {
+        std::string name;
+        unsigned int thread = 0;
+        double start = 0;
+        double wall = 0;
+        // Of the recording thread only, see ProfileScope.
+        double cpu = 0;
+        size_t allocations = 0;
+        size_t bytes = 0;
+        size_t items = 0;
+    };
+
+    /**
+     * Collects timed pipeline stages of one or more conversions and writes them
+     * as a JSON report or as Chrome trace events (chrome://tracing, Perfetto).
+     *
+     * Stages are recorded through ProfileScope, which does nothing when given
+     * a null profiler, so unprofiled conversions only pay for a pointer check.
+     */
+    class Profiler {
+    public:
+        /**
+         * Reads the process wide operator new totals. The library does not
+         * replace operator new itself; hosts that do (the cli) install a reader,
+         * otherwise allocation columns stay zero.
+         */
+        typedef void (*AllocationReader)(size_t *count, size_t *bytes);
+        static AllocationReader allocationReader;
+
+        Profiler();
+
+        /**
+         * Seconds since the profiler was created.
+         */
+        double now() const;
+
+        void add(ProfileStage stage);
+
+        std::vector<ProfileStage> stages() const;
+
+        void writeJson(std::ostream &stream) const;
+
+        void writeChromeTrace(std::ostream &stream) const;
+
+    private:
+        std::chrono::steady_clock::time_point origin;
+        mutable std::mutex mutex;
+        std::vector<ProfileStage> recorded;
+        std::vector<std::thread::id> threads;
+    };
+
+    /**
+     * Records wall time, the cpu time of the current thread and allocations
+     * between construction and destruction as one stage of `profiler`.
+     */
+    class ProfileScope {
+    public:
+        ProfileScope(Profiler *profiler, const char *name);
+
+        ~ProfileScope();
+
+        void items(size_t count) {
+            stage.items = count;
+        }
+
+        /**
+         * Removes a stage that ran inside this one from its totals.
+         */
+        void exclude(const ProfileStage &nested);
+
+    private:
+        Profiler *profiler;
+        ProfileStage stage;
+        double cpuStart = 0;
+        size_t allocationStart = 0;
+        size_t byteStart = 0;
+    };
+
+    /**
+     * Forwards to another sink and accounts the time spent inside it as the
+     * "write" stage, reported by finish().
+     */
+    class ProfiledSink : public SvgSink {
+    public:
+        ProfiledSink(SvgSink &sink, Profiler *profiler);
+
+        void write(const char *data, size_t size) override;
+
+        void flush() override;
+
+        const ProfileStage &stage() const {
+            return writeStage;
+        }
+
+        void finish();
+
+    private:
+        SvgSink &sink;
+        Profiler *profiler;
+        ProfileStage writeStage;
+        bool started = false;
+    };
+}
+
+#endif //AUTOSVG_WASM_PROFILER_HPP
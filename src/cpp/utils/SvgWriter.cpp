@@ -0,0 +1,103 @@
+#include <cerrno>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "SvgWriter.hpp"
+
+using namespace std;
+
+namespace pi {
+    void OStreamSink::write(const char *data, size_t size) {
+        stream.write(data, size);
+        if (!stream) {
+            throw runtime_error("Unable to write svg output");
+        }
+    }
+
+    void OStreamSink::flush() {
+        stream.flush();
+    }
+
+    void FileDescriptorSink::write(const char *data, size_t size) {
+        while (size > 0) {
+            auto written = ::write(fd, data, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error("Unable to write svg output");
+            }
+            data += written;
+            size -= written;
+        }
+    }
+
+    SvgWriter::SvgWriter(SvgSink &sink, size_t bufferSize) : sink(sink), ownBuffer(bufferSize), buffer(ownBuffer) {}
+
+    SvgWriter::SvgWriter(SvgSink &sink, vector<char> &storage) : sink(sink), buffer(storage) {
+        if (buffer.size() < SVG_WRITER_BUFFER_SIZE) {
+            buffer.resize(SVG_WRITER_BUFFER_SIZE);
+        }
+    }
+
+    SvgWriter::~SvgWriter() {
+        try {
+            flush();
+        } catch (...) {
+        }
+    }
+
+    void SvgWriter::flush() {
+        if (used > 0) {
+            sink.write(buffer.data(), used);
+            used = 0;
+        }
+    }
+
+    void SvgWriter::appendInt(long value) {
+        char digits[24];
+        char *end = digits + sizeof(digits);
+        char *cursor = end;
+        unsigned long magnitude = value < 0 ? 0UL - (unsigned long) value : (unsigned long) value;
+        do {
+            *--cursor = char('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude > 0);
+        if (value < 0) {
+            *--cursor = '-';
+        }
+        append(cursor, end - cursor);
+    }
+
+    void SvgWriter::begin(const vector<SVGParam> &params) {
+        append("<svg");
+        for (const auto &param : params) {
+            append(' ');
+            append(param.key);
+            append("=\"");
+            append(param.value);
+            append('"');
+        }
+        append(" >\n");
+    }
+
+    void SvgWriter::beginPath() {
+        append("<path d=\"");
+    }
+
+    void SvgWriter::endPath(const Pixel &fill) {
+        append("\" fill=\"rgb(");
+        appendInt(int(fill.x));
+        append(',');
+        appendInt(int(fill.y));
+        append(',');
+        appendInt(int(fill.z));
+        append(")\" />\n");
+    }
+
+    void SvgWriter::end() {
+        append("</svg>");
+        flush();
+        sink.flush();
+    }
+}
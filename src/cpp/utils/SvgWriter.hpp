@@ -0,0 +1,134 @@
+#ifndef AUTOSVG_WASM_SVGWRITER_HPP
+#define AUTOSVG_WASM_SVGWRITER_HPP
+
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <utils/Constants.hpp>
+
+#define SVG_WRITER_BUFFER_SIZE (64 * 1024)
+
+namespace pi {
+
+    /**
+     * Destination of serialized svg bytes.
+     */
+    class SvgSink {
+    public:
+        virtual ~SvgSink() {}
+
+        virtual void write(const char *data, size_t size) = 0;
+
+        virtual void flush() {}
+    };
+
+    class OStreamSink : public SvgSink {
+    private:
+        std::ostream &stream;
+    public:
+        explicit OStreamSink(std::ostream &stream) : stream(stream) {}
+
+        void write(const char *data, size_t size) override;
+
+        void flush() override;
+    };
+
+    class FileDescriptorSink : public SvgSink {
+    private:
+        int fd;
+    public:
+        explicit FileDescriptorSink(int fd) : fd(fd) {}
+
+        void write(const char *data, size_t size) override;
+    };
+
+    /**
+     * Collects the whole document in memory, for callers that need a string.
+     */
+    class BufferSink : public SvgSink {
+    public:
+        std::string buffer;
+
+        explicit BufferSink(size_t reserve = SVG_WRITER_BUFFER_SIZE) {
+            buffer.reserve(reserve);
+        }
+
+        void write(const char *data, size_t size) override {
+            buffer.append(data, size);
+        }
+    };
+
+    /**
+     * Serializes an svg document into a sink in one linear pass. Output is staged
+     * in a fixed size buffer, so memory stays bounded however large the
+     * document gets.
+     */
+    class SvgWriter {
+    private:
+        SvgSink &sink;
+        std::vector<char> ownBuffer;
+        std::vector<char> &buffer;
+        size_t used = 0;
+
+    public:
+        explicit SvgWriter(SvgSink &sink, size_t bufferSize = SVG_WRITER_BUFFER_SIZE);
+
+        /**
+         * Stages output in `storage`, which is grown to SVG_WRITER_BUFFER_SIZE
+         * if smaller, so callers can keep the buffer across documents.
+         */
+        SvgWriter(SvgSink &sink, std::vector<char> &storage);
+
+        ~SvgWriter();
+
+        SvgWriter(const SvgWriter &) = delete;
+
+        SvgWriter &operator=(const SvgWriter &) = delete;
+
+        void begin(const std::vector<SVGParam> &params);
+
+        /**
+         * Opens a <path> element and its `d` attribute; path data is appended
+         * with append()/appendInt() until endPath() closes the element.
+         */
+        void beginPath();
+
+        void endPath(const Pixel &fill);
+
+        void end();
+
+        void flush();
+
+        void append(const char *data, size_t size) {
+            if (used + size > buffer.size()) {
+                flush();
+                if (size > buffer.size()) {
+                    sink.write(data, size);
+                    return;
+                }
+            }
+            memcpy(buffer.data() + used, data, size);
+            used += size;
+        }
+
+        void append(const std::string &value) {
+            append(value.data(), value.size());
+        }
+
+        void append(const char *value) {
+            append(value, strlen(value));
+        }
+
+        void append(char value) {
+            if (used == buffer.size()) {
+                flush();
+            }
+            buffer[used++] = value;
+        }
+
+        void appendInt(long value);
+    };
+}
+
+#endif //AUTOSVG_WASM_SVGWRITER_HPP
@@ -0,0 +1,112 @@
+#ifndef AUTOSVG_WASM_WORKERPOOL_HPP
+#define AUTOSVG_WASM_WORKERPOOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pi {
+
+    /**
+     * Fixed set of worker threads draining a bounded job queue.
+     * submit() blocks while the queue is full, so producers can never
+     * get further ahead of the workers than `capacity` jobs.
+     */
+    class WorkerPool {
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> jobs;
+        mutable std::mutex lock;
+        std::condition_variable jobAvailable;
+        std::condition_variable slotAvailable;
+        std::condition_variable drained;
+        size_t capacity;
+        size_t running = 0;
+        bool stopping = false;
+
+        void work() {
+            for (;;) {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    jobAvailable.wait(guard, [this]() { return stopping || !jobs.empty(); });
+                    if (jobs.empty()) {
+                        return;
+                    }
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                    running++;
+                }
+                slotAvailable.notify_one();
+                job();
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    running--;
+                    if (jobs.empty() && running == 0) {
+                        drained.notify_all();
+                    }
+                }
+            }
+        }
+
+    public:
+        explicit WorkerPool(unsigned int threads, size_t capacity = 0) {
+            threads = threads > 0 ? threads : 1;
+            this->capacity = capacity > 0 ? capacity : threads * 2;
+            for (unsigned int i = 0; i < threads; i++) {
+                workers.emplace_back(&WorkerPool::work, this);
+            }
+        }
+
+        WorkerPool(const WorkerPool &) = delete;
+
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        ~WorkerPool() {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            jobAvailable.notify_all();
+            for (auto &worker : workers) {
+                worker.join();
+            }
+        }
+
+        void submit(std::function<void()> job) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                slotAvailable.wait(guard, [this]() { return jobs.size() < capacity; });
+                jobs.push_back(std::move(job));
+            }
+            jobAvailable.notify_one();
+        }
+
+        void wait() {
+            std::unique_lock<std::mutex> guard(lock);
+            drained.wait(guard, [this]() { return jobs.empty() && running == 0; });
+        }
+
+        size_t size() const {
+            return workers.size();
+        }
+
+        /**
+         * Jobs submitted but not yet started.
+         */
+        size_t queued() const {
+            std::lock_guard<std::mutex> guard(lock);
+            return jobs.size();
+        }
+
+        size_t active() const {
+            std::lock_guard<std::mutex> guard(lock);
+            return running;
+        }
+    };
+}
+
+#endif //AUTOSVG_WASM_WORKERPOOL_HPP